@@ -0,0 +1,163 @@
+#include "ofMain.h"
+#include "ofxCvBatchCalibration.h"
+#include "ofxCvCalibrationRegression.h"
+#include "ofxCvProjectorLatency.h"
+
+// Headless calibration of recorded sessions, e.g. :
+// ./example-batch-calibration --camera-frames cam/ --projector-frames session.mov --output calib/
+// or, checked against a known good calibration, with a simulated dataset :
+// ./example-batch-calibration --reference calib/ --synthetic 30 --max-stage-time stereoCalibrate=2
+// or, latency measurement against a simulated projector & camera :
+// ./example-batch-calibration --latency-check 0.05,0.03
+
+static void printUsage(){
+    cout << "usage : example-batch-calibration --projector-frames <dir|video> [options]\n"
+         << "  --camera-frames <dir|video>     frames of the printed board only\n"
+         << "  --camera-calibration <file>     use an existing calibrationCamera.yml instead\n"
+         << "  --projector-size <w>x<h>        default 1280x800\n"
+         << "  --threads <n>                   default : one per core\n"
+         << "  --threshold <0-255>             circle detection threshold, default 220\n"
+         << "  --boards-per-frame <n>          several boards per frame, the projector showing\n"
+         << "                                  n copies of the pattern side by side, default 1\n"
+         << "  --output <dir>                  default : current directory\n"
+         << "regression mode, exits with 2 when the result is out of tolerance :\n"
+         << "  --reference <dir>               known good calibration files to compare to\n"
+         << "  --synthetic <n>                 simulate n boards of the reference rig instead of frames\n"
+         << "  --seed <n>                      random seed of the simulation, default 0\n"
+         << "  --noise <px>                    detection noise of the simulation, default 0.1\n"
+         << "  --max-stage-time <stage>=<s>    e.g. stereoCalibrate=2, can be repeated\n"
+         << "  --latency-check <d>,<c>         simulated display & capture delays in s, no frames needed\n"
+         << "  --latency-tolerance <s>         default 0.01\n";
+}
+
+int main(int argc, char * argv[]) {
+
+    string cameraFrames, cameraCalibration, projectorFrames, output;
+    int projectorWidth = 1280, projectorHeight = 800;
+    int numThreads = 0;
+    int threshold = 220;
+    int boardsPerFrame = 1;
+    string reference;
+    int numSynthetic = 0;
+    unsigned long long seed = 0;
+    float noise = 0.1;
+    vector<string> maxStageTimes;
+    string latencyCheck;
+    double latencyTolerance = 0.01;
+
+    for(int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool bHasValue = i + 1 < argc;
+        if(arg == "--camera-frames" && bHasValue) cameraFrames = argv[++i];
+        else if(arg == "--camera-calibration" && bHasValue) cameraCalibration = argv[++i];
+        else if(arg == "--projector-frames" && bHasValue) projectorFrames = argv[++i];
+        else if(arg == "--output" && bHasValue) output = argv[++i];
+        else if(arg == "--threads" && bHasValue) numThreads = ofToInt(argv[++i]);
+        else if(arg == "--threshold" && bHasValue) threshold = ofToInt(argv[++i]);
+        else if(arg == "--boards-per-frame" && bHasValue) boardsPerFrame = ofToInt(argv[++i]);
+        else if(arg == "--reference" && bHasValue) reference = argv[++i];
+        else if(arg == "--synthetic" && bHasValue) numSynthetic = ofToInt(argv[++i]);
+        else if(arg == "--seed" && bHasValue) seed = strtoull(argv[++i], NULL, 10);
+        else if(arg == "--noise" && bHasValue) noise = ofToFloat(argv[++i]);
+        else if(arg == "--max-stage-time" && bHasValue) maxStageTimes.push_back(argv[++i]);
+        else if(arg == "--latency-check" && bHasValue) latencyCheck = argv[++i];
+        else if(arg == "--latency-tolerance" && bHasValue) latencyTolerance = ofToFloat(argv[++i]);
+        else if(arg == "--projector-size" && bHasValue) {
+            vector<string> size = ofSplitString(argv[++i], "x");
+            if(size.size() == 2) {
+                projectorWidth = ofToInt(size[0]);
+                projectorHeight = ofToInt(size[1]);
+            }
+        }
+        else {
+            printUsage();
+            return 1;
+        }
+    }
+
+    if(!latencyCheck.empty()) {
+        vector<string> delays = ofSplitString(latencyCheck, ",");
+        if(delays.size() != 2) {
+            printUsage();
+            return 1;
+        }
+        ofxCv::LatencyCheck check;
+        bool bPassed = check.run(ofToFloat(delays[0]), ofToFloat(delays[1]), latencyTolerance);
+        cout << check.getReport();
+        cout << (bPassed ? "latency check passed" : "latency check FAILED") << endl;
+        return bPassed ? 0 : 2;
+    }
+
+    bool bSynthetic = numSynthetic > 0;
+    if(bSynthetic && reference.empty()) {
+        printUsage();
+        return 1;
+    }
+    if(!bSynthetic && (projectorFrames.empty() || (cameraFrames.empty() && cameraCalibration.empty()))) {
+        printUsage();
+        return 1;
+    }
+
+    ofxCv::CalibrationRegression regression;
+    ofxCv::CameraProjectorCalibration referenceCalibration;
+    if(!reference.empty()) {
+        if(!ofxCv::CalibrationRegression::loadReference(ofFilePath::getAbsolutePath(reference, false), referenceCalibration)) {
+            return 1;
+        }
+        for(size_t i = 0; i < maxStageTimes.size(); i++) {
+            vector<string> stageTime = ofSplitString(maxStageTimes[i], "=");
+            if(stageTime.size() != 2) {
+                printUsage();
+                return 1;
+            }
+            regression.setMaxStageTime(stageTime[0], ofToFloat(stageTime[1]));
+        }
+        if(bSynthetic) {
+            cv::Size size = referenceCalibration.getCalibrationProjector().getDistortedIntrinsics().getImageSize();
+            projectorWidth = size.width;
+            projectorHeight = size.height;
+        }
+    }
+
+    ofxCv::BatchCalibration batch;
+    batch.setup(projectorWidth, projectorHeight, numThreads);
+    batch.setCircleDetectionThreshold(threshold);
+    batch.setMaxBoardsPerFrame(boardsPerFrame);
+
+    float startTime = ofGetElapsedTimef();
+
+    if(bSynthetic) {
+        ofxCv::CalibrationRegression::generateSynthetic(referenceCalibration, batch, numSynthetic, noise, seed);
+    } else if(!cameraFrames.empty()) {
+        int found = batch.addCameraFrames(ofFilePath::getAbsolutePath(cameraFrames, false));
+        ofLogNotice() << found << " camera boards found";
+    } else {
+        batch.loadCameraCalibration(ofFilePath::getAbsolutePath(cameraCalibration, false));
+    }
+
+    if(!bSynthetic) {
+        int found = batch.addProjectorFrames(ofFilePath::getAbsolutePath(projectorFrames, false));
+        ofLogNotice() << found << " projected patterns found";
+        ofLogNotice() << batch.getNumFrames() << " frames processed in " << ofGetElapsedTimef() - startTime << "s";
+    }
+
+    if(!batch.calibrate()) {
+        return 1;
+    }
+
+    // the reference isn't overwritten unless asked for
+    if(reference.empty() || !output.empty()) {
+        if(output.empty()) output = ".";
+        batch.save(ofFilePath::getAbsolutePath(output, false));
+        ofLogNotice() << "calibration saved to " << output;
+    }
+
+    if(!reference.empty()) {
+        bool bPassed = regression.check(referenceCalibration, batch);
+        cout << regression.getReport();
+        cout << (bPassed ? "regression passed" : "regression FAILED") << endl;
+        if(!bPassed) return 2;
+    }
+
+    return 0;
+}
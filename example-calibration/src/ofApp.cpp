@@ -17,25 +17,26 @@ void ofApp::setup(){
     ofBackground(0,0,0);
     
 	cam.initGrabber(640, 480);
-	imitate(previous, cam);
-	imitate(diff, cam);
     
     screenRect.set(0,0,1280,800);
     projectorRect.set(1280,0,1280,800);
     
     camProjCalib.setup(projectorRect.width, projectorRect.height);
+    patternRasterizer.setup(projectorRect.width, projectorRect.height, 4);
+    patternTexture.allocate(projectorRect.width, projectorRect.height, GL_LUMINANCE);
+    camProjCalib.setBoardSelection(true);
+    ofAddListener(camProjCalib.calibrationEvent, this, &ofApp::onCalibrationEvent);
     
     setupDefaultParams();
     setupGui();
+    updateSettings();
     
-	lastTime = 0;
-    bProjectorRefreshLock = true;
-    
-    bLog = true;
-    
-    setState(PROJECTOR_STATIC);
+    // resumes the previous session if the app was closed or crashed
+    if(!camProjCalib.openSession("session.obs")) {
+        camProjCalib.setState(CameraProjectorCalibration::PROJECTOR_STATIC);
+    }
     
-    log() << "Calibration started at step : " << getCurrentStateString() << endl;
+    log("Calibration started at step : " + CameraProjectorCalibration::getStateName(camProjCalib.getState()));
 }
 
 void ofApp::setupDefaultParams(){
@@ -51,6 +52,8 @@ void ofApp::setupDefaultParams(){
     boardsParams.add( numBoardsBeforeDynamicProjection.set("Num boards before dynamic proj", 5, 3, 10) );
     boardsParams.add( maxReprojErrorCamera.set("Max reproj error Camera", 0.2, 0.1, 0.5) );
     boardsParams.add( maxReprojErrorProjector.set("Max reproj error Projector", 0.6, 0.1, 1.0) );
+    boardsParams.add( targetStdDevCamera.set("Target focal std dev Camera", 1.0, 0.1, 5.0) );
+    boardsParams.add( targetStdDevProjector.set("Target focal std dev Projector", 2.0, 0.1, 10.0) );
     
     imageProcessingParams.setName("Processing Params");
     imageProcessingParams.add( circleDetectionThreshold.set("Circle image threshold", 220, 150, 255) );
@@ -68,7 +71,7 @@ void ofApp::setupGui(){
     gui.setBackgroundColor(ofColor(0,0,0,0));
     gui.setPosition(640*1.5 + 10, 10);
     
-    gui.add( currStateString.set("Current State", getCurrentStateString()) );
+    gui.add( currStateString.set("Current State", "") );
     
     gui.add(appParams);
     gui.add(boardsParams);
@@ -77,44 +80,32 @@ void ofApp::setupGui(){
     gui.loadFromFile("settings.xml");
 }
 
-#pragma mark - App states
+#pragma mark - Calibration
 
-void ofApp::setState(CalibState state){
-    
-    CameraCalibration & calibrationCamera = camProjCalib.getCalibrationCamera();
-    ProjectorCalibration & calibrationProjector = camProjCalib.getCalibrationProjector();
-    
-    switch (state) {
-        case CAMERA:
-            camProjCalib.resetBoards();
-            break;
-        case PROJECTOR_STATIC:
-            calibrationCamera.load("calibrationCamera.yml");
-            camProjCalib.resetBoards();
-            calibrationCamera.setupCandidateObjectPoints();
-            calibrationProjector.setStaticCandidateImagePoints();
-            break;
-        case PROJECTOR_DYNAMIC:
-            break;
-        default:
-            break;
-    }
-    currState = state;
-    
-    currStateString = getCurrentStateString();
-    log() << "Set state : " << getCurrentStateString() << endl;
+void ofApp::updateSettings(){
+    
+    CameraProjectorCalibration::Settings & settings = camProjCalib.getSettings();
+    settings.diffMinBetweenFrames = diffMinBetweenFrames;
+    settings.timeMinBetweenCaptures = timeMinBetweenCaptures;
+    settings.numBoardsFinalCamera = numBoardsFinalCamera;
+    settings.numBoardsFinalProjector = numBoardsFinalProjector;
+    settings.numBoardsBeforeCleaning = numBoardsBeforeCleaning;
+    settings.numBoardsBeforeDynamicProjection = numBoardsBeforeDynamicProjection;
+    settings.maxReprojErrorCamera = maxReprojErrorCamera;
+    settings.maxReprojErrorProjector = maxReprojErrorProjector;
+    settings.targetStdDevCamera = targetStdDevCamera;
+    settings.targetStdDevProjector = targetStdDevProjector;
+    settings.circleDetectionThreshold = circleDetectionThreshold;
 }
 
-string ofApp::getCurrentStateString(){
+void ofApp::onCalibrationEvent(CameraProjectorCalibration::Event & e){
     
-    string name;
-    switch (currState) {
-        case CAMERA:            name = "CAMERA"; break;
-        case PROJECTOR_STATIC:  name = "PROJECTOR_STATIC"; break;
-        case PROJECTOR_DYNAMIC: name = "PROJECTOR_DYNAMIC"; break;
-        default: break;
+    if(e.type == CameraProjectorCalibration::Event::STATE_CHANGED) {
+        currStateString = CameraProjectorCalibration::getStateName(e.state);
+        if(e.state == CameraProjectorCalibration::FINISHED) {
+            log("Congrats, you made it ;)");
+        }
     }
-    return name;
 }
 
 #pragma mark - Update
@@ -126,166 +117,21 @@ void ofApp::update(){
 	if(cam.isFrameNew()) {		
 		Mat camMat = toCv(cam);
         
-        switch (currState) {
-                
-            case CAMERA:
-                if( !updateCamDiff(camMat) ) return;
-                
-                if( calibrateCamera(camMat) ){
-                    lastTime = ofGetElapsedTimef();
-                }
-                break;
-                
-            case PROJECTOR_STATIC:
-                if( !updateCamDiff(camMat) ) return;
-                
-                if( calibrateProjector(camMat) ){
-                    lastTime = ofGetElapsedTimef();
-                }
-                break;
-                
-            case PROJECTOR_DYNAMIC:
-                if(bProjectorRefreshLock){
-                    if( camProjCalib.setDynamicProjectorImagePoints(camMat) ){
-                        if( !updateCamDiff(camMat) ) return;
-                        
-                        bProjectorRefreshLock = false;
-                    }
-                }
-                else {
-                    if( calibrateProjector(camMat) ) {
-                        lastTime = ofGetElapsedTimef();
-                    }
-                    bProjectorRefreshLock = true;
-                }
-                break;
-                
-            default: break;
-        }
-    }
-}
-
-bool ofApp::updateCamDiff(cv::Mat camMat) {
-    
-    Mat prevMat = toCv(previous);
-    Mat diffMat = toCv(diff);
-    absdiff(prevMat, camMat, diffMat);
-    diffMean = mean(Mat(mean(diffMat)))[0];
-    camMat.copyTo(prevMat);
-    
-    float timeDiff = ofGetElapsedTimef() - lastTime;
-    
-    return timeMinBetweenCaptures < timeDiff && diffMinBetweenFrames > diffMean;
-}
-
-void ofApp::processImageForCircleDetection(cv::Mat img){
-    
-    if(img.type() != CV_8UC1) {
-        cvtColor(img, processedImg, CV_RGB2GRAY);
-    } else {
-        processedImg = img;
-    }
-    cv::threshold(processedImg, processedImg, circleDetectionThreshold, 255, cv::THRESH_BINARY_INV);
-}
-
-bool ofApp::calibrateCamera(cv::Mat img){
-    
-    CameraCalibration & calibrationCamera = camProjCalib.getCalibrationCamera();
-    
-    bool bFound = calibrationCamera.add(img);
-    if(bFound){
-        
-        log() << "Found board!" << endl;
-        
-        calibrationCamera.calibrate();
-        
-        if(calibrationCamera.size() >= numBoardsBeforeCleaning) {
-            
-            log() << "Cleaning" << endl;
-            
-            calibrationCamera.clean(maxReprojErrorCamera);
-            
-            if(calibrationCamera.getReprojectionError(calibrationCamera.size()-1) > maxReprojErrorCamera) {
-                log() << "Board found, but reproj. error is too high, skipping" << endl;
-                return false;
-            }
-        }
-        
-        if (calibrationCamera.size()>=numBoardsFinalCamera) {
-            
-            calibrationCamera.save("calibrationCamera.yml");
-            
-            log() << "Camera calibration finished & saved to calibrationCamera.yml" << endl;
-            
-            setState(PROJECTOR_STATIC);
-        }
-    } else log() << "Could not find board" << endl;
-    
-    return bFound;
-}
-
-bool ofApp::calibrateProjector(cv::Mat img){
-    
-    CameraCalibration & calibrationCamera = camProjCalib.getCalibrationCamera();
-    ProjectorCalibration & calibrationProjector = camProjCalib.getCalibrationProjector();
-    
-    processImageForCircleDetection(img);
-    
-    if(camProjCalib.addProjected(img, processedImg)){
-        
-        log() << "Calibrating projector" << endl;
-        
-        calibrationProjector.calibrate();
-        
-        if(calibrationProjector.size() >= numBoardsBeforeCleaning) {
-            
-            log() << "Cleaning" << endl;
-            
-            int numBoardRemoved = camProjCalib.cleanStereo(maxReprojErrorProjector);
-            
-            log() << numBoardRemoved << " boards removed";
-            
-            if(currState == PROJECTOR_DYNAMIC && calibrationProjector.size() < numBoardsBeforeDynamicProjection) {
-                log() << "Too many boards removed, restarting to PROJECTOR_STATIC" << endl;
-                setState(PROJECTOR_STATIC);
-                return false;
+        if(latencyEstimator.isMeasuring()) {
+            latencyEstimator.addCameraFrame(camMat, ofGetElapsedTimef());
+            if(latencyEstimator.isDone()) {
+                camProjCalib.getCaptureScheduler().setLatency(latencyEstimator.getLatency());
+                log("Projector to camera latency : " + ofToString(latencyEstimator.getLatency() * 1000) + "ms"
+                    + " (confidence " + ofToString(latencyEstimator.getConfidence()) + ")");
             }
+            return;
         }
         
-        log() << "Performing stereo-calibration" << endl;
-        
-        camProjCalib.stereoCalibrate();
-        
-        log() << "Done" << endl;
-        
-        if(currState == PROJECTOR_STATIC) {
-            
-            if( calibrationProjector.size() < numBoardsBeforeDynamicProjection) {
-                log() << numBoardsBeforeDynamicProjection - calibrationProjector.size() << " boards to go before dynamic projection" << endl;
-            } else {
-                setState(PROJECTOR_DYNAMIC);
-            }
-            
-        } else {
-            
-            if( calibrationProjector.size() < numBoardsFinalProjector) {
-                log() << numBoardsFinalProjector - calibrationProjector.size() << " boards to go to completion" << endl;
-            } else {
-                calibrationProjector.save("calibrationProjector.yml");
-                log() << "Projector calibration finished & saved to calibrationProjector.yml" << endl;
-                
-                camProjCalib.saveExtrinsics("CameraProjectorExtrinsics.yml");
-                log() << "Stereo Calibration finished & saved to CameraProjectorExtrinsics.yml" << endl;
-                
-                log() << "Congrats, you made it ;)" << endl;
-            }
-        }
-        return true;
+        updateSettings();
+        camProjCalib.update(camMat);
     }
-    return false;
 }
 
-
 #pragma mark - Draw
 
 void ofApp::draw(){
@@ -295,18 +141,21 @@ void ofApp::draw(){
     
     gui.draw();
     
-    ofDrawBitmapStringHighlight("Movement: "+ofToString(diffMean), 10, 20, ofxCv::cyanPrint);
+    ofDrawBitmapStringHighlight("Movement: "+ofToString(camProjCalib.getFrameDifference()), 10, 20, ofxCv::cyanPrint);
     
     drawReprojErrors("Camera", camProjCalib.getCalibrationCamera(), 40);
     
-    switch (currState) {
-        case CAMERA:
+    switch (camProjCalib.getState()) {
+        case CameraProjectorCalibration::CAMERA:
             drawReprojLog(camProjCalib.getCalibrationCamera(), 60);
             break;
-        case PROJECTOR_STATIC:
-        case PROJECTOR_DYNAMIC:
+        case CameraProjectorCalibration::PROJECTOR_STATIC:
+        case CameraProjectorCalibration::PROJECTOR_DYNAMIC:
+        case CameraProjectorCalibration::FINISHED:
             drawReprojErrors("Projector", camProjCalib.getCalibrationProjector(), 60);
-            drawReprojLog(camProjCalib.getCalibrationProjector(), 80);
+            drawExtrinsicsUncertainty(80);
+            drawReprojLog(camProjCalib.getCalibrationProjector(), 100);
+            processedImg = camProjCalib.getProcessedImage();
             if(ofxCv::getAllocated(processedImg)){
                 ofxCv::drawMat(processedImg, 640, 0, 320, 240);
             }
@@ -320,10 +169,22 @@ void ofApp::draw(){
     ofDrawBitmapString(getLog(20), 10, cam.height+20);
 }
 
-void ofApp::drawReprojErrors(string name, const ofxCv::Calibration & calib, int y){
+void ofApp::drawReprojErrors(string name, const ofxCv::CalibrationPatched & calib, int y){
     string buff;
     buff = name + " Reproj. Error: " + ofToString(calib.getReprojectionError(), 2);
     buff += " from " + ofToString(calib.size());
+    cv::Mat stdDev = calib.getUncertainty().getStdDev();
+    if(!stdDev.empty()) {
+        buff += " - focal std dev: " + ofToString(stdDev.at<double>(0), 2);
+    }
+    ofDrawBitmapStringHighlight(buff, 10, y, ofxCv::magentaPrint);
+}
+
+void ofApp::drawExtrinsicsUncertainty(int y){
+    cv::Mat stdDev = camProjCalib.getExtrinsicsUncertainty().getStdDev();
+    if(stdDev.empty()) return;
+    string buff = "Extrinsics std dev - rot: " + ofToString(ofRadToDeg(cv::norm(stdDev.rowRange(0, 3))), 3) + "deg";
+    buff += " trans: " + ofToString(cv::norm(stdDev.rowRange(3, 6)), 3);
     ofDrawBitmapStringHighlight(buff, 10, y, ofxCv::magentaPrint);
 }
 
@@ -350,43 +211,60 @@ void ofApp::drawLastCameraImagePoints(){
 
 void ofApp::drawProjectorPattern(){
     
-    ofRectangle vp = ofGetCurrentViewport();
-    ofViewport(projectorRect);
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    glOrtho(0, projectorRect.width, projectorRect.height, 0, -1, 1);
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
-    {
-        ofSetColor(ofColor::white);
-        for(const auto & p : camProjCalib.getCalibrationProjector().getCandidateImagePoints()) {
-            ofCircle(p.x, p.y, 4);
+    if(latencyEstimator.isMeasuring()) {
+        ofSetColor(latencyEstimator.nextFlash(ofGetElapsedTimef()));
+        ofRect(projectorRect);
+    }
+    else {
+        const cv::Mat & pattern = patternRasterizer.getImage();
+        if(patternRasterizer.update(camProjCalib.getCalibrationProjector().getCandidateImagePoints())) {
+            patternTexture.loadData(pattern.ptr(), pattern.cols, pattern.rows, GL_LUMINANCE);
         }
+        ofSetColor(ofColor::white);
+        patternTexture.draw(projectorRect.x, projectorRect.y);
+        camProjCalib.getCaptureScheduler().patternDisplayed(ofGetElapsedTimef());
+    }
+}
+
+void ofApp::startLatencyMeasurement(){
+    if(camProjCalib.getState() == CameraProjectorCalibration::CAMERA) {
+        log("Latency can only be measured while the projector pattern is displayed");
+        return;
     }
-    ofViewport(vp);
+    log("Measuring projector to camera latency, point the camera at the projection");
+    latencyEstimator.start();
 }
 
 #pragma mark - Inputs
 
 void ofApp::keyPressed(int key){
     
-    
+    switch (key) {
+        case 'l':
+            startLatencyMeasurement();
+            break;
+        case 'n':
+            camProjCalib.openSession("session.obs", false);
+            camProjCalib.setState(CameraProjectorCalibration::PROJECTOR_STATIC);
+            break;
+        case 'e':
+            camProjCalib.exportEventLog("events.csv");
+            log("Events exported to events.csv");
+            break;
+        default:
+            break;
+    }
 }
 
 #pragma mark - Log
 
 string ofApp::getLog(int numLines){
     
-    vector<string> elems;
-    stringstream ss(log_.str());
+    logRecords.clear();
+    camProjCalib.getEventLog().getLast(numLines, logRecords);
     string buff;
-    while (getline(ss, buff)) elems.push_back(buff);
-    numLines = fmin(elems.size(), numLines);
-    buff = "";
-    if(elems.size()>0) {
-        for (int i=elems.size()-1; i>elems.size()-numLines; i--) {
-            buff = elems[i] + "\n" + buff;
-        }
+    for (size_t i=0; i<logRecords.size(); i++) {
+        buff += string(logRecords[i].message) + "\n";
     }
     return buff;
 }
@@ -5,12 +5,6 @@
 #include "ofxCv.h"
 #include "ofxCvCameraProjectorCalibration.h"
 
-enum CalibState {
-    CAMERA,
-    PROJECTOR_STATIC,
-    PROJECTOR_DYNAMIC
-};
-
 class ofApp : public ofBaseApp {
 public:
 	void setup();
@@ -22,37 +16,31 @@ public:
     
     ofVideoGrabber cam;
     
-    void setState(CalibState state);
-    string getCurrentStateString();
-    
-    bool calibrateCamera(cv::Mat img);
-    bool calibrateProjector(cv::Mat img);
-    
 private:
     
-    CalibState currState;
+    // calibration events
     
-    // circles detection
+    void onCalibrationEvent(ofxCv::CameraProjectorCalibration::Event & e);
+    void updateSettings();
     
-    void processImageForCircleDetection(cv::Mat camMat);
-    cv::Mat processedImg;
+    // measures the latency used by the library capture scheduler
     
-    // board holding movement
+    ofxCv::LatencyEstimator latencyEstimator;
+    void startLatencyMeasurement();
     
-    ofPixels previous;
-	ofPixels diff;
-	float diffMean;
-	float lastTime;
-    bool updateCamDiff(cv::Mat camMat);
-
-    // lock to give enough time for the projection to be seen by the camera
+    // processed image of the library, for display
     
-    bool bProjectorRefreshLock;
+    cv::Mat processedImg;
     
     // screen & projector configuration
     
-    ofRectangle projectorRect;
     ofRectangle screenRect;
+    ofRectangle projectorRect;
+    
+    // cached projector pattern, uploaded only when the points move
+    
+    ofxCv::PatternRasterizer patternRasterizer;
+    ofTexture patternTexture;
     
     // gui
     
@@ -61,19 +49,19 @@ private:
     
     // draw
     
-    void drawReprojErrors(string name, const ofxCv::Calibration & calib, int y);
+    void drawReprojErrors(string name, const ofxCv::CalibrationPatched & calib, int y);
+    void drawExtrinsicsUncertainty(int y);
     void drawReprojLog(const ofxCv::Calibration & calib, int y);
     void drawLastCameraImagePoints();
     void drawProjectorPattern();
     
     // log
     
-    stringstream log_;
-    stringstream & log() {
-        return log_;
+    void log(const string & message) {
+        camProjCalib.logMessage(message);
     }
-    bool bLog;
     string getLog(int numLines=15);
+    vector<ofxCv::EventLog::Record> logRecords;
     
     // params
     
@@ -90,6 +78,8 @@ private:
     ofParameter<int> numBoardsBeforeDynamicProjection;
     ofParameter<float> maxReprojErrorCamera;
     ofParameter<float> maxReprojErrorProjector;
+    ofParameter<float> targetStdDevCamera;
+    ofParameter<float> targetStdDevProjector;
     
     ofParameterGroup imageProcessingParams;
     ofParameter<int> circleDetectionThreshold;
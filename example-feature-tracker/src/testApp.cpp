@@ -21,11 +21,16 @@ void testApp::setup() {
 }
 
 void testApp::setupCamProj(){
-    rotObjToProj = Mat::zeros(3, 1, CV_64F);
-    transObjToProj = Mat::zeros(3, 1, CV_64F);
     rotObjToCam = Mat::zeros(3, 1, CV_64F);
     transObjToCam = Mat::zeros(3, 1, CV_64F);
     camproj.load("calibrationCamera.yml", "calibrationProjector.yml", "CameraProjectorExtrinsics.yml");
+    calibrationStore.publish(camproj);
+    calibrationStore.watch("calibrationCamera.yml", "calibrationProjector.yml", "CameraProjectorExtrinsics.yml");
+    calibrationReader.setup(calibrationStore);
+    
+    // camera capture + tracking + projector display, in seconds
+    posePredictor.setLatency(0.08);
+    maxPredictionGap = 0.25;
 }
 
 void testApp::setupTracker(){
@@ -37,6 +42,7 @@ void testApp::setupTracker(){
 
 void testApp::exit() {
     ofLog() << "Exiting app";
+    calibrationStore.stopWatching();
     //tracker.waitForThread(true);
 }
 
@@ -48,6 +54,10 @@ void testApp::update() {
     
     if(cam.isFrameNew()) {
         
+        // the pose is measured on this frame : its arrival, not the time the tracking
+        // result is read, is what the predictor extrapolates from
+        double frameTime = ofGetElapsedTimef();
+        
         tracker.update(cam);
         
         bFound = false;
@@ -62,12 +72,20 @@ void testApp::update() {
             for (int i=0; i<3; i++) { *tvec.ptr<double>(i) *= 9.35; } // TODO : find this scaling value in configuration files
             *tvec.ptr<double>(1) += 1; // TODO : remove this y axis hack
             
-            // smooth results
-            rotObjToCam += (rvec-rotObjToCam) * 0.3;
-            transObjToCam += (tvec-transObjToCam) * 0.3;
+            // filter results & extrapolate them to the time they'll be displayed
+            posePredictor.update(rvec, tvec, frameTime);
+            posePredictor.predict(rotObjToCam, transObjToCam);
             
             bFound = true;
         }
+        else if(posePredictor.isInitialized() && frameTime - posePredictor.getLastTimestamp() < maxPredictionGap) {
+            // dropped detections are bridged by the filter's motion, without a new measurement
+            posePredictor.predictAt(frameTime + posePredictor.getLatency(), rotObjToCam, transObjToCam);
+            bFound = true;
+        }
+        else {
+            posePredictor.reset();
+        }
 	}
 }
 
@@ -107,7 +125,9 @@ void testApp::drawUsingCV(){
     inPts.push_back(Point3f(-w, h, 0));
     
     // get videoproj's projection of inputPts
-    vector<cv::Point2f> outPts = camproj.getProjected(inPts, rotObjToCam, transObjToCam);
+    // held until the end of the frame, even if a reload replaces it meanwhile
+    std::shared_ptr<const CalibrationSnapshot> calibration = calibrationReader.get();
+    vector<cv::Point2f> outPts = calibration->getProjected(inPts, rotObjToCam, transObjToCam);
     
     // project the inputPts over the object
     ofPushMatrix();
@@ -131,16 +151,12 @@ void testApp::drawUsingCV(){
 
 void testApp::drawUsingGL(){
     
-    ofPushMatrix();
-    
-    // Set perspective matrix using the projector intrinsics
-    camproj.getCalibrationProjector().getDistortedIntrinsics().loadProjectionMatrix(1, 10000, cv::Point2d(1280, 0));
+    // the matrices are only recomputed when the calibration or the pose changed
+    projectorMatrices.setCalibration(*calibrationReader.get());
+    projectorMatrices.setObjectPose(rotObjToCam, transObjToCam);
     
-    // apply model to projector transformations
-    cv::composeRT(rotObjToCam,  transObjToCam,
-                  camproj.getCamToProjRotation(), camproj.getCamToProjTranslation(),
-                  rotObjToProj, transObjToProj);
-    applyMatrix(makeMatrix(rotObjToProj, transObjToProj));
+    // projector intrinsics & object to projector transformation, restored by end()
+    projectorMatrices.begin(cv::Point2d(1280, 0));
     
     ofVec2f bookSizeCm = ofVec2f(12.5, 19);
     ofVec2f bookSizePx = ofVec2f(305, 468);
@@ -160,9 +176,7 @@ void testApp::drawUsingGL(){
         ofRect(-cw*0.5, -ch*0.5, cw, ch);
     }
     
-    ofPopMatrix();
-    
-    // TODO : restore GL matrices
+    projectorMatrices.end();
 }
 
 string testApp::getRTMatInfos(const cv::Mat rvecs, const cv::Mat tvecs){
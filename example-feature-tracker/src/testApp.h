@@ -4,6 +4,8 @@
 #include "ofxCv.h"
 #include "ofxCvFeaturesTrackerThreaded.h"
 #include "ofxCvCameraProjectorCalibration.h"
+#include "ofxCvCalibrationSnapshot.h"
+#include "ofxCvProjectorMatrices.h"
 
 #define SCREEN_WIDTH 1280
 #define SCREEN_HEIGHT 800
@@ -35,8 +37,18 @@ private:
     
     ofxCv::FeaturesTrackerThreaded tracker;
     ofxCv::CameraProjectorCalibration camproj;
+    // reloaded when the calibration files are updated during the show
+    ofxCv::CalibrationStore calibrationStore;
+    // render thread side of the store, doesn't wait on a reload
+    ofxCv::CalibrationStore::Reader calibrationReader;
     cv::Mat rotObjToCam, transObjToCam;
-    cv::Mat rotObjToProj, transObjToProj;
+    // GL matrices of the projector, cached between frames
+    ofxCv::ProjectorMatrices projectorMatrices;
+    
+    // extrapolates the tracked pose to the projector display time
+    ofxCv::PosePredictor posePredictor;
+    // seconds without detection after which the prediction stops
+    double maxPredictionGap;
     
     bool bDrawDebug;
     bool bDrawWithCV;
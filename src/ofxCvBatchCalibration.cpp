@@ -0,0 +1,293 @@
+/*
+ * ofxCvBatchCalibration.cpp
+ *
+ * Headless calibration from recorded sessions : frames are read from a
+ * directory of images or a video file, boards & circle grids are detected
+ * across a worker pool, and the detections are fed to CameraProjectorCalibration
+ * in frame order so the results don't depend on the number of threads.
+ */
+
+#include "ofxCvBatchCalibration.h"
+
+namespace ofxCv {
+
+    namespace {
+        bool isImageFile(const string & path) {
+            string ext = ofToLower(ofFilePath::getFileExt(path));
+            return ext == "png" || ext == "jpg" || ext == "jpeg" || ext == "bmp" || ext == "tif" || ext == "tiff";
+        }
+
+        cv::Mat readImage(const string & path) {
+            cv::Mat img = cv::imread(path);
+            // openFrameworks frames are RGB
+            if(!img.empty()) cv::cvtColor(img, img, CV_BGR2RGB);
+            return img;
+        }
+    }
+
+    BatchCalibration::BatchCalibration()
+    :circleDetectionThreshold(220)
+    ,maxReprojErrorCamera(0.2)
+    ,maxReprojErrorProjector(0.6)
+    ,chunkSize(64)
+    ,maxBoardsPerFrame(1)
+    ,numFrames(0) {
+    }
+
+    void BatchCalibration::setup(int projectorWidth, int projectorHeight, int numThreads){
+        camProjCalib.setup(projectorWidth, projectorHeight);
+        projectorSize = cv::Size(projectorWidth, projectorHeight);
+        workers.setup(numThreads);
+        // the frames are already spread across the workers, the regions of each frame aren't
+        multiBoardDetector.setup(camProjCalib, 1);
+        setMaxBoardsPerFrame(maxBoardsPerFrame);
+    }
+
+    void BatchCalibration::setMaxBoardsPerFrame(int maxBoards){
+        maxBoardsPerFrame = MAX(1, maxBoards);
+        multiBoardDetector.setMaxBoards(maxBoardsPerFrame);
+        ProjectorCalibration & calibrationProjector = camProjCalib.getCalibrationProjector();
+        calibrationProjector.setStaticCandidateImagePoints();
+        if(maxBoardsPerFrame > 1) {
+            multiBoardDetector.setProjectedPatterns(MultiBoardDetector::makePatternRow(calibrationProjector.getCandidateImagePoints(),
+                                                                                       projectorSize, maxBoardsPerFrame));
+        }
+    }
+
+    void BatchCalibration::setCircleDetectionThreshold(int threshold){
+        circleDetectionThreshold = threshold;
+        multiBoardDetector.setCircleDetectionThreshold(threshold);
+    }
+
+    void BatchCalibration::setMaxReprojErrors(float camera, float projector){
+        maxReprojErrorCamera = camera;
+        maxReprojErrorProjector = projector;
+    }
+
+    void BatchCalibration::detectCamera(const cv::Mat & img, FrameDetection & detection){
+        detection.imageSize = img.size();
+        if(maxBoardsPerFrame > 1) {
+            detection.bFound = multiBoardDetector.detectBoards(img, detection.boards, false) > 0;
+            return;
+        }
+        detection.bFound = camProjCalib.getCalibrationCamera().detectBoard(img, detection.chessImgPts);
+    }
+
+    void BatchCalibration::detectProjector(const cv::Mat & img, FrameDetection & detection){
+        if(maxBoardsPerFrame > 1) {
+            detection.imageSize = img.size();
+            detection.bFound = multiBoardDetector.detectProjected(img, detection.boards, false) > 0;
+            return;
+        }
+        cv::Mat processedImg;
+        camProjCalib.processImageForCircleDetection(img, processedImg, circleDetectionThreshold);
+        detection.imageSize = img.size();
+        detection.bFound = camProjCalib.detectProjected(img, processedImg,
+                                                        detection.chessImgPts,
+                                                        detection.circlesImgPts);
+    }
+
+    void BatchCalibration::detectFrames(const string & path, const Detector & detector,
+                                        vector<FrameDetection> & results){
+        results.clear();
+
+        if(ofFile(path).isDirectory()) {
+            // images are decoded on the workers too
+            ofDirectory dir(path);
+            dir.listDir();
+            dir.sort();
+            vector<string> files;
+            for(int i = 0; i < (int) dir.size(); i++) {
+                if(isImageFile(dir.getPath(i))) files.push_back(dir.getPath(i));
+            }
+            results.resize(files.size());
+            for(size_t start = 0; start < files.size(); start += chunkSize) {
+                int count = MIN(chunkSize, (int) (files.size() - start));
+                workers.parallelFor(count, [&](int i) {
+                    cv::Mat img = readImage(files[start + i]);
+                    if(!img.empty()) detector(img, results[start + i]);
+                });
+            }
+        } else {
+            // video decoding is sequential, detection runs on each decoded chunk
+            cv::VideoCapture video(path);
+            if(!video.isOpened()) {
+                ofLogError("BatchCalibration") << "can't open " << path;
+                return;
+            }
+            vector<cv::Mat> chunk;
+            bool bEnd = false;
+            while(!bEnd) {
+                chunk.clear();
+                cv::Mat frame;
+                while((int) chunk.size() < chunkSize) {
+                    if(!video.read(frame)) {
+                        bEnd = true;
+                        break;
+                    }
+                    cv::Mat rgb;
+                    cv::cvtColor(frame, rgb, CV_BGR2RGB);
+                    chunk.push_back(rgb);
+                }
+                size_t start = results.size();
+                results.resize(start + chunk.size());
+                workers.parallelFor(chunk.size(), [&](int i) {
+                    detector(chunk[i], results[start + i]);
+                });
+            }
+        }
+        numFrames += results.size();
+    }
+
+    void BatchCalibration::addStageTime(const string & stage, unsigned long long startTime){
+        float seconds = (ofGetElapsedTimeMicros() - startTime) / 1e6;
+        stageTimes.push_back(make_pair(stage, seconds));
+    }
+
+    void BatchCalibration::addDetections(const vector<FrameDetection> & results, vector<FrameDetection> & detections) const {
+        for(size_t i = 0; i < results.size(); i++) {
+            if(!results[i].bFound) continue;
+            if(results[i].boards.empty()) {
+                detections.push_back(results[i]);
+                continue;
+            }
+            for(size_t j = 0; j < results[i].boards.size(); j++) {
+                const MultiBoardDetector::Detection & board = results[i].boards[j];
+                FrameDetection detection;
+                detection.bFound = true;
+                detection.imageSize = results[i].imageSize;
+                detection.chessImgPts = board.chessImgPts;
+                detection.circlesImgPts = board.circlesImgPts;
+                detection.projectorImgPts = board.projectorImgPts;
+                detections.push_back(detection);
+            }
+        }
+    }
+
+    int BatchCalibration::addCameraFrames(const string & path){
+        unsigned long long startTime = ofGetElapsedTimeMicros();
+        vector<FrameDetection> results;
+        detectFrames(path, [this](const cv::Mat & img, FrameDetection & detection) {
+            detectCamera(img, detection);
+        }, results);
+
+        int found = cameraDetections.size();
+        addDetections(results, cameraDetections);
+        addStageTime("cameraDetection", startTime);
+        return cameraDetections.size() - found;
+    }
+
+    int BatchCalibration::addProjectorFrames(const string & path){
+        unsigned long long startTime = ofGetElapsedTimeMicros();
+        vector<FrameDetection> results;
+        detectFrames(path, [this](const cv::Mat & img, FrameDetection & detection) {
+            detectProjector(img, detection);
+        }, results);
+
+        int found = projectorDetections.size();
+        addDetections(results, projectorDetections);
+        addStageTime("projectorDetection", startTime);
+        return projectorDetections.size() - found;
+    }
+
+    void BatchCalibration::addCameraDetection(const vector<cv::Point2f> & chessImgPts, cv::Size imageSize){
+        FrameDetection detection;
+        detection.bFound = true;
+        detection.imageSize = imageSize;
+        detection.chessImgPts = chessImgPts;
+        cameraDetections.push_back(detection);
+    }
+
+    void BatchCalibration::addProjectorDetection(const vector<cv::Point2f> & chessImgPts, const vector<cv::Point2f> & circlesImgPts,
+                                                 cv::Size imageSize, const vector<cv::Point2f> & projectorImgPts){
+        FrameDetection detection;
+        detection.bFound = true;
+        detection.imageSize = imageSize;
+        detection.chessImgPts = chessImgPts;
+        detection.circlesImgPts = circlesImgPts;
+        detection.projectorImgPts = projectorImgPts;
+        projectorDetections.push_back(detection);
+    }
+
+    void BatchCalibration::loadCameraCalibration(const string & path){
+        camProjCalib.getCalibrationCamera().load(path, true);
+    }
+
+    bool BatchCalibration::calibrate(){
+
+        CameraCalibration & calibrationCamera = camProjCalib.getCalibrationCamera();
+        ProjectorCalibration & calibrationProjector = camProjCalib.getCalibrationProjector();
+
+        // the detection stages were timed when the frames were added
+        for(int i = stageTimes.size() - 1; i >= 0; i--) {
+            if(stageTimes[i].first != "cameraDetection" && stageTimes[i].first != "projectorDetection") {
+                stageTimes.erase(stageTimes.begin() + i);
+            }
+        }
+        unsigned long long startTime = ofGetElapsedTimeMicros();
+
+        if(!cameraDetections.empty()) {
+            calibrationCamera.resetBoards();
+            for(size_t i = 0; i < cameraDetections.size(); i++) {
+                calibrationCamera.addImagePoints(cameraDetections[i].chessImgPts, cameraDetections[i].imageSize);
+            }
+            calibrationCamera.calibrateWithUncertainty();
+            calibrationCamera.cleanWithUncertainty(maxReprojErrorCamera);
+            addStageTime("cameraCalibration", startTime);
+            ofLogNotice("BatchCalibration") << "camera : " << calibrationCamera.size() << " boards, "
+                                            << "reprojection error " << calibrationCamera.getReprojectionError();
+        }
+        if(!calibrationCamera.isReady()) {
+            ofLogError("BatchCalibration") << "no camera calibration available";
+            return false;
+        }
+
+        camProjCalib.resetBoards();
+        calibrationCamera.setupCandidateObjectPoints();
+        calibrationProjector.setStaticCandidateImagePoints();
+
+        startTime = ofGetElapsedTimeMicros();
+        for(size_t i = 0; i < projectorDetections.size(); i++) {
+            const FrameDetection & detection = projectorDetections[i];
+            if(detection.projectorImgPts.empty()) {
+                calibrationProjector.setStaticCandidateImagePoints();
+            } else {
+                calibrationProjector.setCandidateImagePoints(detection.projectorImgPts);
+            }
+            camProjCalib.addProjected(detection.chessImgPts, detection.circlesImgPts);
+        }
+        addStageTime("addProjected", startTime);
+        if(calibrationProjector.size() == 0) {
+            ofLogError("BatchCalibration") << "no projected pattern found";
+            return false;
+        }
+
+        startTime = ofGetElapsedTimeMicros();
+        calibrationProjector.calibrateWithUncertainty();
+        addStageTime("projectorCalibration", startTime);
+
+        startTime = ofGetElapsedTimeMicros();
+        int removed = camProjCalib.cleanStereo(maxReprojErrorProjector);
+        if(removed > 0) calibrationProjector.calibrateWithUncertainty();
+        addStageTime("cleanStereo", startTime);
+
+        startTime = ofGetElapsedTimeMicros();
+        camProjCalib.stereoCalibrate();
+        addStageTime("stereoCalibrate", startTime);
+
+        startTime = ofGetElapsedTimeMicros();
+        float rms = camProjCalib.bundleAdjust();
+        addStageTime("bundleAdjust", startTime);
+
+        ofLogNotice("BatchCalibration") << "projector : " << calibrationProjector.size() << " boards ("
+                                        << removed << " removed), joint RMS error " << rms;
+        return true;
+    }
+
+    void BatchCalibration::save(const string & directory) const {
+        string dir = ofFilePath::addTrailingSlash(directory);
+        camProjCalib.getCalibrationCamera().save(dir + "calibrationCamera.yml", true);
+        camProjCalib.getCalibrationProjector().save(dir + "calibrationProjector.yml", true);
+        camProjCalib.saveExtrinsics(dir + "CameraProjectorExtrinsics.yml", true);
+    }
+}
@@ -0,0 +1,95 @@
+/*
+ * ofxCvBatchCalibration.h
+ *
+ * Headless calibration from recorded sessions : frames are read from a
+ * directory of images or a video file, boards & circle grids are detected
+ * across a worker pool, and the detections are fed to CameraProjectorCalibration
+ * in frame order so the results don't depend on the number of threads.
+ */
+
+#pragma once
+
+#include "ofMain.h"
+#include "ofxCv.h"
+#include "ofxCvCameraProjectorCalibration.h"
+#include "ofxCvWorkerPool.h"
+#include "ofxCvMultiBoardDetector.h"
+
+namespace ofxCv {
+
+    class BatchCalibration {
+
+    public:
+        BatchCalibration();
+
+        void setup(int projectorWidth, int projectorHeight, int numThreads = 0);
+        void setCircleDetectionThreshold(int threshold);
+        void setMaxReprojErrors(float camera, float projector);
+        // number of frames decoded & detected per parallel batch
+        void setChunkSize(int numFrames) { chunkSize = MAX(1, numFrames); }
+        // several boards per frame, each one an observation. The projector frames then
+        // show one copy of the static pattern per board, spread across its width
+        void setMaxBoardsPerFrame(int maxBoards);
+        MultiBoardDetector & getMultiBoardDetector() { return multiBoardDetector; }
+
+        // printed board only, for the camera intrinsics
+        int addCameraFrames(const string & path);
+        // printed board + static projected circles pattern
+        int addProjectorFrames(const string & path);
+        // skips the camera frames
+        void loadCameraCalibration(const string & path);
+        // detections made elsewhere (e.g. simulated), projectorImgPts is the pattern
+        // displayed for that frame, the static pattern when empty
+        void addCameraDetection(const vector<cv::Point2f> & chessImgPts, cv::Size imageSize);
+        void addProjectorDetection(const vector<cv::Point2f> & chessImgPts, const vector<cv::Point2f> & circlesImgPts,
+                                   cv::Size imageSize, const vector<cv::Point2f> & projectorImgPts = vector<cv::Point2f>());
+
+        bool calibrate();
+        void save(const string & directory) const;
+
+        CameraProjectorCalibration & getCalibration() { return camProjCalib; }
+        const CameraProjectorCalibration & getCalibration() const { return camProjCalib; }
+        int getNumFrames() const { return numFrames; }
+        // wall time of each stage of the last run, in seconds
+        const vector<pair<string, float> > & getStageTimes() const { return stageTimes; }
+
+    protected:
+
+        struct FrameDetection {
+            FrameDetection() : bFound(false) {}
+            bool bFound;
+            cv::Size imageSize;
+            vector<cv::Point2f> chessImgPts;
+            vector<cv::Point2f> circlesImgPts;
+            vector<cv::Point2f> projectorImgPts;
+            // every board of the frame, when detecting several
+            vector<MultiBoardDetector::Detection> boards;
+        };
+
+        typedef std::function<void(const cv::Mat &, FrameDetection &)> Detector;
+
+        // decodes & detects every frame of a directory or video, results are in frame order
+        void detectFrames(const string & path, const Detector & detector, vector<FrameDetection> & results);
+        // called from the workers, only read the members
+        void detectCamera(const cv::Mat & img, FrameDetection & detection);
+        void detectProjector(const cv::Mat & img, FrameDetection & detection);
+        void addStageTime(const string & stage, unsigned long long startTime);
+        // one detection per board
+        void addDetections(const vector<FrameDetection> & results, vector<FrameDetection> & detections) const;
+
+        CameraProjectorCalibration camProjCalib;
+        WorkerPool workers;
+        MultiBoardDetector multiBoardDetector;
+
+        vector<FrameDetection> cameraDetections;
+        vector<FrameDetection> projectorDetections;
+        vector<pair<string, float> > stageTimes;
+
+        int circleDetectionThreshold;
+        float maxReprojErrorCamera, maxReprojErrorProjector;
+        int chunkSize;
+        int maxBoardsPerFrame;
+        cv::Size projectorSize;
+        int numFrames;
+    };
+}
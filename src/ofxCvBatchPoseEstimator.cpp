@@ -0,0 +1,92 @@
+/*
+ * ofxCvBatchPoseEstimator.cpp
+ *
+ * Estimates the poses of many tracked objects per frame (one solvePnP per
+ * correspondence set) and projects them into the projector, spread across a
+ * worker pool with the intrinsics and extrinsics set up once.
+ */
+
+#include "ofxCvBatchPoseEstimator.h"
+
+namespace ofxCv {
+
+    BatchPoseEstimator::BatchPoseEstimator() {
+    }
+
+    void BatchPoseEstimator::setup(const CalibrationSnapshot & calibration, int numThreads){
+        cameraMatrix = calibration.getCameraIntrinsics().getCameraMatrix().clone();
+        cameraDistCoeffs = calibration.getCameraDistCoeffs().clone();
+        cameraLens = LensModel<double>(cameraMatrix, cameraDistCoeffs);
+        projectorLens = LensModel<float>(calibration.getProjectorIntrinsics().getCameraMatrix(),
+                                         calibration.getProjectorDistCoeffs());
+        if(!calibration.getCamToProjRotation().empty() && !calibration.getCamToProjTranslation().empty()) {
+            camToProj = RigidPose<float>(calibration.getCamToProjRotation(), calibration.getCamToProjTranslation());
+        }
+        workers.setup(numThreads);
+    }
+
+    void BatchPoseEstimator::setup(const CameraProjectorCalibration & calibration, int numThreads){
+        setup(CalibrationSnapshot(calibration), numThreads);
+    }
+
+    void BatchPoseEstimator::estimate(const vector<Target> & targets, vector<Result> & results, int outputs){
+        results.resize(targets.size());
+        workers.parallelFor(targets.size(), [&](int i) {
+            // an exception escaping a worker would terminate the process
+            try {
+                estimate(targets[i], results[i], outputs);
+            } catch(cv::Exception & e) {
+                results[i].bFound = false;
+                results[i].projected.clear();
+                ofLogWarning("BatchPoseEstimator") << "target " << i << " : " << e.what();
+            }
+        });
+    }
+
+    void BatchPoseEstimator::estimate(const Target & target, Result & result, int outputs) const {
+
+        result.bFound = false;
+        result.reprojError = 0;
+
+        if(outputs & POSES) {
+            int numPoints = target.objectPoints.size();
+            if(numPoints < 4 || target.imagePoints.size() != target.objectPoints.size()) {
+                result.projected.clear();
+                return;
+            }
+            bool bUseGuess = target.bUseGuess && !target.rot.empty() && !target.trans.empty();
+            if(bUseGuess) {
+                target.rot.convertTo(result.rot, CV_64F);
+                target.trans.convertTo(result.trans, CV_64F);
+            }
+            // the shared matrices are only read, no copy per task
+            cv::solvePnP(target.objectPoints, target.imagePoints, cameraMatrix, cameraDistCoeffs,
+                         result.rot, result.trans, bUseGuess);
+
+            vector<cv::Point2f> reprojected;
+            projectToImage(cameraLens, RigidPose<double>(result.rot, result.trans), target.objectPoints, reprojected);
+            double squaredError = 0;
+            for(int i = 0; i < numPoints; i++) {
+                cv::Point2f d = reprojected[i] - target.imagePoints[i];
+                squaredError += d.dot(d);
+            }
+            result.reprojError = sqrt(squaredError / numPoints);
+        } else {
+            if(target.rot.empty() || target.trans.empty()) {
+                result.projected.clear();
+                return;
+            }
+            target.rot.convertTo(result.rot, CV_64F);
+            target.trans.convertTo(result.trans, CV_64F);
+        }
+        result.bFound = true;
+
+        if(outputs & PROJECTIONS) {
+            const vector<cv::Point3f> & pts = target.pointsToProject.empty() ? target.objectPoints : target.pointsToProject;
+            RigidPose<float> objToProj = RigidPose<float>(result.rot, result.trans).then(camToProj);
+            projectToImage(projectorLens, objToProj, pts, result.projected);
+        } else {
+            result.projected.clear();
+        }
+    }
+}
@@ -0,0 +1,69 @@
+/*
+ * ofxCvBatchPoseEstimator.h
+ *
+ * Estimates the poses of many tracked objects per frame (one solvePnP per
+ * correspondence set) and projects them into the projector, spread across a
+ * worker pool with the intrinsics and extrinsics set up once.
+ */
+
+#pragma once
+
+#include "ofMain.h"
+#include "ofxCv.h"
+#include "ofxCvCalibrationSnapshot.h"
+#include "ofxCvWorkerPool.h"
+
+namespace ofxCv {
+
+    class BatchPoseEstimator {
+
+    public:
+        enum Output {
+            POSES = 1,
+            PROJECTIONS = 2,
+            POSES_AND_PROJECTIONS = 3
+        };
+
+        struct Target {
+            Target() : bUseGuess(false) {}
+            // correspondences in the camera image, ignored when only projecting. Not found
+            // if the two lists differ in size
+            vector<cv::Point3f> objectPoints;
+            vector<cv::Point2f> imagePoints;
+            // initial guess (e.g. last frame's pose), or the known pose when only projecting
+            cv::Mat rot, trans;
+            bool bUseGuess;
+            // object frame points to project, the object points when empty
+            vector<cv::Point3f> pointsToProject;
+        };
+
+        struct Result {
+            Result() : bFound(false), reprojError(0) {}
+            bool bFound;
+            // object -> camera
+            cv::Mat rot, trans;
+            // camera RMS reprojection error, in pixels
+            float reprojError;
+            // projector pixels
+            vector<cv::Point2f> projected;
+        };
+
+        BatchPoseEstimator();
+
+        // 0 threads : one per hardware core
+        void setup(const CalibrationSnapshot & calibration, int numThreads = 0);
+        void setup(const CameraProjectorCalibration & calibration, int numThreads = 0);
+
+        // results keep the order of the targets, and their buffers are reused from call to call
+        void estimate(const vector<Target> & targets, vector<Result> & results, int outputs = POSES_AND_PROJECTIONS);
+
+    protected:
+        void estimate(const Target & target, Result & result, int outputs) const;
+
+        cv::Mat cameraMatrix, cameraDistCoeffs;
+        LensModel<double> cameraLens;
+        LensModel<float> projectorLens;
+        RigidPose<float> camToProj;
+        WorkerPool workers;
+    };
+}
@@ -0,0 +1,122 @@
+/*
+ * ofxCvBoardSelector.cpp
+ *
+ * Scores candidate board poses by how much they reduce the uncertainty on the
+ * intrinsics (fx, fy, cx, cy, distortion) given the boards already stored,
+ * so redundant captures can be rejected before any solve.
+ */
+
+#include "ofxCvBoardSelector.h"
+#include "ofxCvCameraProjectorCalibration.h"
+#include "ofxCvCalibrationUncertainty.h"
+
+namespace ofxCv {
+
+    namespace {
+        double logDet(const cv::Mat & symmetric) {
+            cv::Mat eigenValues;
+            cv::eigen(symmetric, eigenValues);
+            double sum = 0;
+            for(int i = 0; i < eigenValues.rows; i++) {
+                sum += log(MAX(eigenValues.at<double>(i), 1e-300));
+            }
+            return sum;
+        }
+    }
+
+    BoardSelector::BoardSelector()
+    :pixelNoise(0.2)
+    ,minInformationGain(0.01)
+    ,targetFocalStdDev(1.0)
+    ,targetPrincipalStdDev(1.0)
+    ,numBoards(0) {
+        setup(cv::Size(640, 480));
+    }
+
+    void BoardSelector::setTargetStdDev(double focal, double principal){
+        targetFocalStdDev = focal;
+        targetPrincipalStdDev = principal;
+    }
+
+    void BoardSelector::setup(cv::Size imageSize, int numDistCoeffs){
+        cameraMatrix = (cv::Mat_<double>(3, 3) <<
+                        imageSize.width, 0, imageSize.width * 0.5,
+                        0, imageSize.width, imageSize.height * 0.5,
+                        0, 0, 1);
+        distCoeffs = cv::Mat::zeros(numDistCoeffs, 1, CV_64F);
+        resetInformation();
+    }
+
+    void BoardSelector::update(CalibrationPatched & calibration){
+        cameraMatrix = calibration.getDistortedIntrinsics().getCameraMatrix().clone();
+        distCoeffs = calibration.getDistCoeffs().clone();
+        resetInformation();
+
+        const vector<vector<Point3f> > & objectPoints = calibration.getObjectPoints();
+        const vector<cv::Mat> & rotations = calibration.getBoardRotations();
+        const vector<cv::Mat> & translations = calibration.getBoardTranslations();
+        int n = MIN(objectPoints.size(), MIN(rotations.size(), translations.size()));
+        for(int i = 0; i < n; i++) {
+            add(objectPoints[i], rotations[i], translations[i]);
+        }
+    }
+
+    void BoardSelector::resetInformation(){
+        int numParams = getNumIntrinsicParams(distCoeffs);
+
+        // weak prior so the information is invertible before the first boards
+        information = cv::Mat::zeros(numParams, numParams, CV_64F);
+        for(int i = 0; i < numParams; i++) {
+            information.at<double>(i, i) = i < 4 ? 1e-6 : 1.;
+        }
+        numBoards = 0;
+    }
+
+    cv::Mat BoardSelector::getBoardInformation(const vector<Point3f> & objectPoints,
+                                               const cv::Mat & boardRot, const cv::Mat & boardTrans) const {
+        BoardInformation board = computeBoardInformation(objectPoints, vector<Point2f>(),
+                                                         boardRot, boardTrans,
+                                                         cameraMatrix, distCoeffs);
+        return board.information / (pixelNoise * pixelNoise);
+    }
+
+    double BoardSelector::getInformationGain(const vector<Point3f> & objectPoints,
+                                             const cv::Mat & boardRot, const cv::Mat & boardTrans) const {
+        cv::Mat boardInformation = getBoardInformation(objectPoints, boardRot, boardTrans);
+
+        // D-optimality : mean log reduction of the parameters std dev
+        double gain = logDet(information + boardInformation) - logDet(information);
+        return 0.5 * gain / information.rows;
+    }
+
+    bool BoardSelector::isInformative(const vector<Point3f> & objectPoints,
+                                      const cv::Mat & boardRot, const cv::Mat & boardTrans) const {
+        return getInformationGain(objectPoints, boardRot, boardTrans) >= minInformationGain;
+    }
+
+    void BoardSelector::add(const vector<Point3f> & objectPoints,
+                            const cv::Mat & boardRot, const cv::Mat & boardTrans){
+        information += getBoardInformation(objectPoints, boardRot, boardTrans);
+        numBoards++;
+    }
+
+    bool BoardSelector::isTargetReached() const {
+        if(numBoards == 0) return false;
+
+        cv::Mat stdDev = getStdDev();
+        return stdDev.at<double>(0) <= targetFocalStdDev
+            && stdDev.at<double>(1) <= targetFocalStdDev
+            && stdDev.at<double>(2) <= targetPrincipalStdDev
+            && stdDev.at<double>(3) <= targetPrincipalStdDev;
+    }
+
+    cv::Mat BoardSelector::getCovariance() const {
+        return information.inv(cv::DECOMP_SVD);
+    }
+
+    cv::Mat BoardSelector::getStdDev() const {
+        cv::Mat stdDev;
+        cv::sqrt(getCovariance().diag(), stdDev);
+        return stdDev;
+    }
+}
@@ -0,0 +1,61 @@
+/*
+ * ofxCvBoardSelector.h
+ *
+ * Scores candidate board poses by how much they reduce the uncertainty on the
+ * intrinsics (fx, fy, cx, cy, distortion) given the boards already stored,
+ * so redundant captures can be rejected before any solve.
+ */
+
+#pragma once
+
+#include "ofMain.h"
+#include "ofxCv.h"
+
+namespace ofxCv {
+
+    class CalibrationPatched;
+
+    class BoardSelector {
+
+    public:
+        BoardSelector();
+
+        // expected detection noise, in pixels
+        void setPixelNoise(double sigma) { pixelNoise = sigma; }
+        // mean relative reduction of the parameters std dev a board must bring (0.01 = 1%)
+        void setMinInformationGain(double gain) { minInformationGain = gain; }
+        // target std dev on the focal lengths and principal point, in pixels
+        void setTargetStdDev(double focal, double principal);
+
+        // linearization point used before any calibration is available
+        void setup(cv::Size imageSize, int numDistCoeffs = 5);
+        // re-linearizes on the current intrinsics & accumulates the stored boards
+        void update(CalibrationPatched & calibration);
+
+        double getInformationGain(const vector<Point3f> & objectPoints,
+                                  const cv::Mat & boardRot, const cv::Mat & boardTrans) const;
+        bool isInformative(const vector<Point3f> & objectPoints,
+                           const cv::Mat & boardRot, const cv::Mat & boardTrans) const;
+        // accumulates a board without re-linearizing
+        void add(const vector<Point3f> & objectPoints,
+                 const cv::Mat & boardRot, const cv::Mat & boardTrans);
+
+        bool isTargetReached() const;
+        // covariance & std dev of [fx fy cx cy k1 k2 p1 p2 k3]
+        cv::Mat getCovariance() const;
+        cv::Mat getStdDev() const;
+
+    protected:
+        void resetInformation();
+        cv::Mat getBoardInformation(const vector<Point3f> & objectPoints,
+                                    const cv::Mat & boardRot, const cv::Mat & boardTrans) const;
+
+        double pixelNoise;
+        double minInformationGain;
+        double targetFocalStdDev, targetPrincipalStdDev;
+
+        cv::Mat cameraMatrix, distCoeffs;
+        cv::Mat information;
+        int numBoards;
+    };
+}
@@ -0,0 +1,497 @@
+/*
+ * ofxCvBundleAdjuster.cpp
+ *
+ * Joint Levenberg-Marquardt refinement of the camera & projector intrinsics,
+ * the camera -> projector extrinsics and every board pose. Board poses only
+ * couple to the shared parameters, so they are eliminated per board with a
+ * Schur complement : each iteration is linear in the number of boards and
+ * observations, and the dense system never exceeds the shared parameters.
+ * With a board limit the oldest boards are marginalized into a prior on the
+ * shared parameters, so memory stays bounded however many boards are added.
+ */
+
+#include "ofxCvBundleAdjuster.h"
+
+namespace ofxCv {
+
+    namespace {
+        cv::Mat toColumn64(const cv::Mat & m) {
+            cv::Mat m64;
+            m.convertTo(m64, CV_64F);
+            return m64.reshape(1, m64.total()).clone();
+        }
+
+        bool invertSymmetric(const cv::Mat & m, cv::Mat & inverse) {
+            if(cv::invert(m, inverse, cv::DECOMP_CHOLESKY) != 0) return true;
+            return cv::invert(m, inverse, cv::DECOMP_SVD) != 0;
+        }
+
+        void addDamping(cv::Mat & m, double lambda) {
+            for(int i = 0; i < m.rows; i++) {
+                m.at<double>(i, i) += lambda * MAX(m.at<double>(i, i), 1e-9);
+            }
+        }
+    }
+
+    BundleAdjuster::BundleAdjuster()
+    :priorSquaredError(0)
+    ,numMarginalizedBoards(0)
+    ,numMarginalizedPoints(0)
+    ,bFixDistortion(false)
+    ,maxIterations(30)
+    ,maxBoards(0)
+    ,maxPointsPerObservation(0)
+    ,numIterations(0)
+    ,rms(0) {
+        for(int i = 0; i < 2; i++) {
+            devices[i].cameraMatrix = cv::Mat::eye(3, 3, CV_64F);
+            devices[i].distCoeffs = cv::Mat::zeros(5, 1, CV_64F);
+        }
+        rotCamToProj = cv::Mat::zeros(3, 1, CV_64F);
+        transCamToProj = cv::Mat::zeros(3, 1, CV_64F);
+        updateOffsets();
+    }
+
+    void BundleAdjuster::setIntrinsics(Device device, const cv::Mat & cameraMatrix, const cv::Mat & distCoeffs){
+        cameraMatrix.convertTo(devices[device].cameraMatrix, CV_64F);
+        devices[device].cameraMatrix = devices[device].cameraMatrix.clone();
+        devices[device].distCoeffs = toColumn64(distCoeffs);
+        updateOffsets();
+    }
+
+    void BundleAdjuster::setExtrinsics(const cv::Mat & rot, const cv::Mat & trans){
+        rotCamToProj = toColumn64(rot);
+        transCamToProj = toColumn64(trans);
+    }
+
+    int BundleAdjuster::addBoard(const cv::Mat & boardRot, const cv::Mat & boardTrans){
+        while(maxBoards > 0 && (int) boards.size() >= maxBoards) {
+            marginalizeBoard(0);
+        }
+        Board board;
+        board.rot = toColumn64(boardRot);
+        board.trans = toColumn64(boardTrans);
+        boards.push_back(board);
+        return boards.size() - 1;
+    }
+
+    void BundleAdjuster::addObservations(int board, Device device,
+                                         const vector<Point3f> & objectPoints,
+                                         const vector<Point2f> & imagePoints){
+        if(objectPoints.empty() || objectPoints.size() != imagePoints.size()) return;
+
+        Observations obs;
+        obs.board = board;
+        obs.device = device;
+        int numPoints = objectPoints.size();
+        if(maxPointsPerObservation > 0 && numPoints > maxPointsPerObservation) {
+            // evenly spaced subset, keeps the coverage of dense correspondences
+            obs.objectPoints.resize(maxPointsPerObservation);
+            obs.imagePoints.resize(maxPointsPerObservation);
+            for(int i = 0; i < maxPointsPerObservation; i++) {
+                int j = (long long) i * numPoints / maxPointsPerObservation;
+                obs.objectPoints[i] = objectPoints[j];
+                obs.imagePoints[i] = imagePoints[j];
+            }
+        } else {
+            obs.objectPoints = objectPoints;
+            obs.imagePoints = imagePoints;
+        }
+        observations.push_back(obs);
+        boards[board].observations.push_back(observations.size() - 1);
+    }
+
+    void BundleAdjuster::removeBoard(int board){
+        // compacts in place, the dropped points are released by the resize
+        size_t numKept = 0;
+        for(size_t i = 0; i < observations.size(); i++) {
+            if(observations[i].board == board) continue;
+            if(observations[i].board > board) observations[i].board--;
+            if(numKept != i) std::swap(observations[numKept], observations[i]);
+            numKept++;
+        }
+        observations.resize(numKept);
+        boards.erase(boards.begin() + board);
+
+        for(size_t b = 0; b < boards.size(); b++) {
+            boards[b].observations.clear();
+        }
+        for(size_t i = 0; i < observations.size(); i++) {
+            boards[observations[i].board].observations.push_back(i);
+        }
+    }
+
+    void BundleAdjuster::marginalizeBoard(int board){
+        updateOffsets();
+        int numGlobal = getNumGlobalParams();
+        const vector<int> & boardObservations = boards[board].observations;
+
+        cv::Mat residuals, jacobianGlobal, jacobianBoard;
+        cv::Mat U, bg, V, W, bb;
+        double squaredError = 0;
+        int numPoints = 0;
+
+        // the summary is only as good as its linearization point, so the pose is
+        // first refined against the current shared parameters
+        for(int iteration = 0; iteration <= 5; iteration++) {
+            U = cv::Mat::zeros(numGlobal, numGlobal, CV_64F);
+            bg = cv::Mat::zeros(numGlobal, 1, CV_64F);
+            V = cv::Mat::zeros(6, 6, CV_64F);
+            W = cv::Mat::zeros(numGlobal, 6, CV_64F);
+            bb = cv::Mat::zeros(6, 1, CV_64F);
+            squaredError = 0;
+            numPoints = 0;
+            for(size_t i = 0; i < boardObservations.size(); i++) {
+                const Observations & obs = observations[boardObservations[i]];
+                linearize(obs, residuals, jacobianGlobal, jacobianBoard);
+                cv::Mat jgt = jacobianGlobal.t();
+                cv::Mat jbt = jacobianBoard.t();
+                U += jgt * jacobianGlobal;
+                bg += jgt * residuals;
+                V += jbt * jacobianBoard;
+                W += jgt * jacobianBoard;
+                bb += jbt * residuals;
+                squaredError += residuals.dot(residuals);
+                numPoints += obs.objectPoints.size();
+            }
+            if(iteration == 5 || numPoints == 0) break;
+
+            cv::Mat delta;
+            if(!cv::solve(V, bb, delta, cv::DECOMP_CHOLESKY)) break;
+            boards[board].rot += delta.rowRange(0, 3);
+            boards[board].trans += delta.rowRange(3, 6);
+        }
+
+        if(numPoints > 0) {
+            cv::Mat params = getGlobalParams();
+            if(priorHessian.empty()) {
+                priorHessian = cv::Mat::zeros(numGlobal, numGlobal, CV_64F);
+                priorGradient = cv::Mat::zeros(numGlobal, 1, CV_64F);
+                priorSquaredError = 0;
+            } else {
+                // moves the existing prior to the current linearization point
+                cv::Mat deltaParams = params - priorParams;
+                priorSquaredError = getPriorSquaredError(deltaParams);
+                priorGradient -= priorHessian * deltaParams;
+            }
+            priorParams = params;
+
+            // Schur complement of the board pose
+            cv::Mat VInv;
+            invertSymmetric(V, VInv);
+            cv::Mat WVInv = W * VInv;
+            priorHessian += U - WVInv * W.t();
+            priorGradient += bg - WVInv * bb;
+            priorSquaredError += squaredError - bb.dot(VInv * bb);
+
+            numMarginalizedBoards++;
+            numMarginalizedPoints += numPoints;
+        }
+
+        removeBoard(board);
+    }
+
+    void BundleAdjuster::clear(){
+        boards.clear();
+        observations.clear();
+        clearPrior();
+        rms = 0;
+        numIterations = 0;
+    }
+
+    void BundleAdjuster::clearPrior(){
+        priorHessian.release();
+        priorGradient.release();
+        priorParams.release();
+        priorSquaredError = 0;
+        numMarginalizedBoards = 0;
+        numMarginalizedPoints = 0;
+    }
+
+    void BundleAdjuster::updateOffsets(){
+        int offset = 0;
+        for(int i = 0; i < 2; i++) {
+            devices[i].numParams = 4 + MIN((int) devices[i].distCoeffs.total(), 5);
+            devices[i].offset = offset;
+            offset += devices[i].numParams;
+        }
+        // the prior no longer matches the parameters
+        if(!priorHessian.empty() && priorHessian.rows != getNumGlobalParams()) {
+            clearPrior();
+        }
+    }
+
+    cv::Mat BundleAdjuster::getGlobalParams() const {
+        cv::Mat params(getNumGlobalParams(), 1, CV_64F);
+        double * p = params.ptr<double>();
+        for(int i = 0; i < 2; i++) {
+            const DeviceParams & device = devices[i];
+            double * dp = p + device.offset;
+            dp[0] = device.cameraMatrix.at<double>(0, 0);
+            dp[1] = device.cameraMatrix.at<double>(1, 1);
+            dp[2] = device.cameraMatrix.at<double>(0, 2);
+            dp[3] = device.cameraMatrix.at<double>(1, 2);
+            for(int k = 4; k < device.numParams; k++) {
+                dp[k] = device.distCoeffs.at<double>(k - 4);
+            }
+        }
+        int ext = getNumGlobalParams() - 6;
+        for(int k = 0; k < 3; k++) {
+            p[ext + k] = rotCamToProj.at<double>(k);
+            p[ext + 3 + k] = transCamToProj.at<double>(k);
+        }
+        return params;
+    }
+
+    double BundleAdjuster::getPriorSquaredError(const cv::Mat & deltaParams) const {
+        if(priorHessian.empty()) return 0;
+        double squaredError = priorSquaredError
+            - 2 * priorGradient.dot(deltaParams)
+            + deltaParams.dot(priorHessian * deltaParams);
+        return MAX(squaredError, 0.);
+    }
+
+    int BundleAdjuster::getNumGlobalParams() const {
+        // [camera fx fy cx cy dist... | projector fx fy cx cy dist... | rot trans]
+        return devices[CAMERA].numParams + devices[PROJECTOR].numParams + 6;
+    }
+
+    void BundleAdjuster::linearize(const Observations & obs, cv::Mat & residuals,
+                                   cv::Mat & jacobianGlobal, cv::Mat & jacobianBoard) const {
+
+        const Board & board = boards[obs.board];
+        const DeviceParams & device = devices[obs.device];
+        int numGlobal = getNumGlobalParams();
+        int numPoints = obs.objectPoints.size();
+
+        cv::Mat rot, trans;
+        cv::Mat dr3dr1, dr3dt1, dr3dr2, dr3dt2, dt3dr1, dt3dt1, dt3dr2, dt3dt2;
+        if(obs.device == CAMERA) {
+            rot = board.rot;
+            trans = board.trans;
+        } else {
+            cv::composeRT(board.rot, board.trans, rotCamToProj, transCamToProj, rot, trans,
+                          dr3dr1, dr3dt1, dr3dr2, dr3dt2, dt3dr1, dt3dt1, dt3dr2, dt3dt2);
+        }
+
+        vector<Point2f> projected;
+        cv::Mat jacobian;
+        cv::projectPoints(cv::Mat(obs.objectPoints), rot, trans,
+                          device.cameraMatrix, device.distCoeffs, projected, jacobian);
+
+        residuals.create(2 * numPoints, 1, CV_64F);
+        for(int i = 0; i < numPoints; i++) {
+            residuals.at<double>(2 * i) = obs.imagePoints[i].x - projected[i].x;
+            residuals.at<double>(2 * i + 1) = obs.imagePoints[i].y - projected[i].y;
+        }
+
+        jacobianGlobal = cv::Mat::zeros(2 * numPoints, numGlobal, CV_64F);
+        jacobianBoard.create(2 * numPoints, 6, CV_64F);
+
+        int numIntrinsics = bFixDistortion ? 4 : device.numParams;
+        jacobian.colRange(6, 6 + numIntrinsics)
+            .copyTo(jacobianGlobal.colRange(device.offset, device.offset + numIntrinsics));
+
+        if(obs.device == CAMERA) {
+            jacobian.colRange(0, 6).copyTo(jacobianBoard);
+        } else {
+            // chain rule through the board -> camera -> projector composition
+            cv::Mat jr3 = jacobian.colRange(0, 3);
+            cv::Mat jt3 = jacobian.colRange(3, 6);
+            int ext = numGlobal - 6;
+
+            cv::Mat(jr3 * dr3dr1 + jt3 * dt3dr1).copyTo(jacobianBoard.colRange(0, 3));
+            cv::Mat(jr3 * dr3dt1 + jt3 * dt3dt1).copyTo(jacobianBoard.colRange(3, 6));
+            cv::Mat(jr3 * dr3dr2 + jt3 * dt3dr2).copyTo(jacobianGlobal.colRange(ext, ext + 3));
+            cv::Mat(jr3 * dr3dt2 + jt3 * dt3dt2).copyTo(jacobianGlobal.colRange(ext + 3, ext + 6));
+        }
+    }
+
+    double BundleAdjuster::buildNormalEquations(cv::Mat & U, cv::Mat & bg,
+                                                vector<cv::Mat> & V, vector<cv::Mat> & W,
+                                                vector<cv::Mat> & bb) const {
+        int numGlobal = getNumGlobalParams();
+        U = cv::Mat::zeros(numGlobal, numGlobal, CV_64F);
+        bg = cv::Mat::zeros(numGlobal, 1, CV_64F);
+        V.resize(boards.size());
+        W.resize(boards.size());
+        bb.resize(boards.size());
+        for(size_t b = 0; b < boards.size(); b++) {
+            V[b] = cv::Mat::zeros(6, 6, CV_64F);
+            W[b] = cv::Mat::zeros(numGlobal, 6, CV_64F);
+            bb[b] = cv::Mat::zeros(6, 1, CV_64F);
+        }
+
+        double squaredError = 0;
+        cv::Mat residuals, jacobianGlobal, jacobianBoard;
+        for(size_t i = 0; i < observations.size(); i++) {
+            const Observations & obs = observations[i];
+            linearize(obs, residuals, jacobianGlobal, jacobianBoard);
+
+            cv::Mat jgt = jacobianGlobal.t();
+            cv::Mat jbt = jacobianBoard.t();
+            U += jgt * jacobianGlobal;
+            bg += jgt * residuals;
+            V[obs.board] += jbt * jacobianBoard;
+            W[obs.board] += jgt * jacobianBoard;
+            bb[obs.board] += jbt * residuals;
+            squaredError += residuals.dot(residuals);
+        }
+
+        if(!priorHessian.empty()) {
+            cv::Mat deltaParams = getGlobalParams() - priorParams;
+            U += priorHessian;
+            bg += priorGradient - priorHessian * deltaParams;
+            squaredError += getPriorSquaredError(deltaParams);
+        }
+
+        // fixed parameters have empty columns, keep the system invertible
+        for(int i = 0; i < numGlobal; i++) {
+            if(U.at<double>(i, i) == 0) U.at<double>(i, i) = 1;
+        }
+        return squaredError;
+    }
+
+    double BundleAdjuster::computeSquaredError() const {
+        double squaredError = 0;
+        for(size_t i = 0; i < observations.size(); i++) {
+            const Observations & obs = observations[i];
+            const Board & board = boards[obs.board];
+            const DeviceParams & device = devices[obs.device];
+
+            cv::Mat rot = board.rot, trans = board.trans;
+            if(obs.device == PROJECTOR) {
+                cv::composeRT(board.rot, board.trans, rotCamToProj, transCamToProj, rot, trans);
+            }
+            vector<Point2f> projected;
+            cv::projectPoints(cv::Mat(obs.objectPoints), rot, trans,
+                              device.cameraMatrix, device.distCoeffs, projected);
+            for(size_t j = 0; j < projected.size(); j++) {
+                Point2f d = obs.imagePoints[j] - projected[j];
+                squaredError += d.dot(d);
+            }
+        }
+        if(!priorHessian.empty()) {
+            squaredError += getPriorSquaredError(getGlobalParams() - priorParams);
+        }
+        return squaredError;
+    }
+
+    void BundleAdjuster::applyUpdate(const cv::Mat & deltaGlobal, const vector<cv::Mat> & deltaBoards){
+        const double * d = deltaGlobal.ptr<double>();
+        for(int i = 0; i < 2; i++) {
+            DeviceParams & device = devices[i];
+            const double * dd = d + device.offset;
+            device.cameraMatrix.at<double>(0, 0) += dd[0];
+            device.cameraMatrix.at<double>(1, 1) += dd[1];
+            device.cameraMatrix.at<double>(0, 2) += dd[2];
+            device.cameraMatrix.at<double>(1, 2) += dd[3];
+            for(int k = 4; k < device.numParams; k++) {
+                device.distCoeffs.at<double>(k - 4) += dd[k];
+            }
+        }
+        int ext = getNumGlobalParams() - 6;
+        rotCamToProj += deltaGlobal.rowRange(ext, ext + 3);
+        transCamToProj += deltaGlobal.rowRange(ext + 3, ext + 6);
+
+        for(size_t b = 0; b < boards.size(); b++) {
+            boards[b].rot += deltaBoards[b].rowRange(0, 3);
+            boards[b].trans += deltaBoards[b].rowRange(3, 6);
+        }
+    }
+
+    void BundleAdjuster::saveState(State & state) const {
+        for(int i = 0; i < 2; i++) {
+            state.devices[i] = devices[i];
+            state.devices[i].cameraMatrix = devices[i].cameraMatrix.clone();
+            state.devices[i].distCoeffs = devices[i].distCoeffs.clone();
+        }
+        state.rotCamToProj = rotCamToProj.clone();
+        state.transCamToProj = transCamToProj.clone();
+        state.boards.resize(boards.size());
+        for(size_t b = 0; b < boards.size(); b++) {
+            state.boards[b].rot = boards[b].rot.clone();
+            state.boards[b].trans = boards[b].trans.clone();
+        }
+    }
+
+    void BundleAdjuster::restoreState(const State & state){
+        for(int i = 0; i < 2; i++) {
+            devices[i].cameraMatrix = state.devices[i].cameraMatrix;
+            devices[i].distCoeffs = state.devices[i].distCoeffs;
+        }
+        rotCamToProj = state.rotCamToProj;
+        transCamToProj = state.transCamToProj;
+        for(size_t b = 0; b < boards.size(); b++) {
+            boards[b].rot = state.boards[b].rot;
+            boards[b].trans = state.boards[b].trans;
+        }
+    }
+
+    double BundleAdjuster::solve(){
+
+        updateOffsets();
+        numIterations = 0;
+
+        // the marginalized points still count, through the prior
+        int numPoints = numMarginalizedPoints;
+        for(size_t i = 0; i < observations.size(); i++) {
+            numPoints += observations[i].objectPoints.size();
+        }
+        if(numPoints == 0) return rms = 0;
+
+        cv::Mat U, bg;
+        vector<cv::Mat> V, W, bb;
+        double squaredError = buildNormalEquations(U, bg, V, W, bb);
+        double lambda = 1e-3;
+
+        vector<cv::Mat> VInv(boards.size()), deltaBoards(boards.size());
+        State previous;
+
+        while(numIterations < maxIterations) {
+            numIterations++;
+
+            // reduced camera system : S = U - sum(W V^-1 W^t)
+            cv::Mat S = U.clone();
+            cv::Mat rhs = bg.clone();
+            addDamping(S, lambda);
+            for(size_t b = 0; b < boards.size(); b++) {
+                cv::Mat Vb = V[b].clone();
+                addDamping(Vb, lambda);
+                invertSymmetric(Vb, VInv[b]);
+                cv::Mat WVInv = W[b] * VInv[b];
+                S -= WVInv * W[b].t();
+                rhs -= WVInv * bb[b];
+            }
+
+            cv::Mat deltaGlobal;
+            if(!cv::solve(S, rhs, deltaGlobal, cv::DECOMP_CHOLESKY)) {
+                cv::solve(S, rhs, deltaGlobal, cv::DECOMP_SVD);
+            }
+            for(size_t b = 0; b < boards.size(); b++) {
+                deltaBoards[b] = VInv[b] * (bb[b] - W[b].t() * deltaGlobal);
+            }
+
+            saveState(previous);
+            applyUpdate(deltaGlobal, deltaBoards);
+            double newSquaredError = computeSquaredError();
+
+            if(newSquaredError < squaredError) {
+                double improvement = (squaredError - newSquaredError) / squaredError;
+                lambda = MAX(lambda * 0.1, 1e-12);
+                if(improvement < 1e-10) {
+                    squaredError = newSquaredError;
+                    break;
+                }
+                squaredError = buildNormalEquations(U, bg, V, W, bb);
+            } else {
+                restoreState(previous);
+                lambda *= 10;
+                if(lambda > 1e10) break;
+            }
+        }
+
+        rms = sqrt(squaredError / numPoints);
+        return rms;
+    }
+}
@@ -0,0 +1,131 @@
+/*
+ * ofxCvBundleAdjuster.h
+ *
+ * Joint Levenberg-Marquardt refinement of the camera & projector intrinsics,
+ * the camera -> projector extrinsics and every board pose. Board poses only
+ * couple to the shared parameters, so they are eliminated per board with a
+ * Schur complement : each iteration is linear in the number of boards and
+ * observations, and the dense system never exceeds the shared parameters.
+ * With a board limit the oldest boards are marginalized into a prior on the
+ * shared parameters, so memory stays bounded however many boards are added.
+ */
+
+#pragma once
+
+#include "ofMain.h"
+#include "ofxCv.h"
+
+namespace ofxCv {
+
+    class BundleAdjuster {
+
+    public:
+        enum Device {
+            CAMERA = 0,
+            PROJECTOR = 1
+        };
+
+        BundleAdjuster();
+
+        void setIntrinsics(Device device, const cv::Mat & cameraMatrix, const cv::Mat & distCoeffs);
+        void setExtrinsics(const cv::Mat & rotCamToProj, const cv::Mat & transCamToProj);
+
+        // board pose in the camera reference frame, returns the board index. When the
+        // board limit is reached the oldest board is marginalized first, shifting the indices
+        int addBoard(const cv::Mat & boardRot, const cv::Mat & boardTrans);
+        // points in the board reference frame seen by a device (chessboard corners,
+        // projected circles, dense structured-light correspondences...)
+        void addObservations(int board, Device device,
+                             const vector<Point3f> & objectPoints,
+                             const vector<Point2f> & imagePoints);
+        // drops a board and its observations without keeping their information
+        void removeBoard(int board);
+        // folds a board into the prior on the shared parameters, then drops it
+        void marginalizeBoard(int board);
+        void clear();
+
+        void setFixDistortion(bool fix) { bFixDistortion = fix; }
+        void setMaxIterations(int iterations) { maxIterations = iterations; }
+        // 0 keeps every board
+        void setMaxBoards(int boards) { maxBoards = boards; }
+        // larger observations are subsampled evenly, 0 keeps every point
+        void setMaxPointsPerObservation(int points) { maxPointsPerObservation = points; }
+
+        // returns the final RMS reprojection error over all observations
+        double solve();
+
+        const cv::Mat & getCameraMatrix(Device device) const { return devices[device].cameraMatrix; }
+        const cv::Mat & getDistCoeffs(Device device) const { return devices[device].distCoeffs; }
+        const cv::Mat & getCamToProjRotation() const { return rotCamToProj; }
+        const cv::Mat & getCamToProjTranslation() const { return transCamToProj; }
+        int getNumBoards() const { return boards.size(); }
+        const cv::Mat & getBoardRotation(int board) const { return boards[board].rot; }
+        const cv::Mat & getBoardTranslation(int board) const { return boards[board].trans; }
+        double getRms() const { return rms; }
+        int getNumIterations() const { return numIterations; }
+        int getNumMarginalizedBoards() const { return numMarginalizedBoards; }
+
+    protected:
+
+        struct DeviceParams {
+            cv::Mat cameraMatrix, distCoeffs;
+            int numParams;
+            int offset;
+        };
+
+        struct Observations {
+            int board;
+            Device device;
+            vector<Point3f> objectPoints;
+            vector<Point2f> imagePoints;
+        };
+
+        struct Board {
+            cv::Mat rot, trans;
+            vector<int> observations;
+        };
+
+        struct State {
+            DeviceParams devices[2];
+            cv::Mat rotCamToProj, transCamToProj;
+            vector<Board> boards;
+        };
+
+        int getNumGlobalParams() const;
+        void updateOffsets();
+        // shared parameters in the order of the normal equations
+        cv::Mat getGlobalParams() const;
+        // error of the marginalized observations, extrapolated from the prior
+        double getPriorSquaredError(const cv::Mat & deltaParams) const;
+        void clearPrior();
+        // J^t J & J^t r of the shared parameters (U, bg), of each board (V, bb) and their coupling (W)
+        double buildNormalEquations(cv::Mat & U, cv::Mat & bg,
+                                    vector<cv::Mat> & V, vector<cv::Mat> & W, vector<cv::Mat> & bb) const;
+        void linearize(const Observations & obs, cv::Mat & residuals,
+                       cv::Mat & jacobianGlobal, cv::Mat & jacobianBoard) const;
+        double computeSquaredError() const;
+        void applyUpdate(const cv::Mat & deltaGlobal, const vector<cv::Mat> & deltaBoards);
+
+        void saveState(State & state) const;
+        void restoreState(const State & state);
+
+        DeviceParams devices[2];
+        cv::Mat rotCamToProj, transCamToProj;
+        vector<Board> boards;
+        vector<Observations> observations;
+
+        // marginalized boards as a quadratic around priorParams :
+        // error(x) = priorSquaredError - 2 g^t (x - x0) + (x - x0)^t H (x - x0)
+        cv::Mat priorHessian, priorGradient, priorParams;
+        double priorSquaredError;
+        int numMarginalizedBoards;
+        int numMarginalizedPoints;
+
+        bool bFixDistortion;
+        int maxIterations;
+        int maxBoards;
+        int maxPointsPerObservation;
+        int numIterations;
+        double rms;
+    };
+}
@@ -0,0 +1,260 @@
+/*
+ * ofxCvCalibrationRegression.cpp
+ *
+ * Accuracy & throughput checks of the batch calibration pipeline : compares
+ * a result to reference calibration files within tolerances, bounds the time
+ * of each stage, and simulates datasets from a reference camera-projector rig.
+ */
+
+#include "ofxCvCalibrationRegression.h"
+#include "ofxCvProjectorMatrices.h"
+
+namespace ofxCv {
+
+    namespace {
+        bool isInside(const vector<cv::Point2f> & pts, cv::Size size) {
+            for(size_t i = 0; i < pts.size(); i++) {
+                if(pts[i].x < 0 || pts[i].y < 0 || pts[i].x >= size.width || pts[i].y >= size.height) return false;
+            }
+            return true;
+        }
+
+        void addNoise(vector<cv::Point2f> & pts, cv::RNG & rng, float noise) {
+            for(size_t i = 0; i < pts.size(); i++) {
+                pts[i].x += rng.gaussian(noise);
+                pts[i].y += rng.gaussian(noise);
+            }
+        }
+
+        // board pose in the camera frame, centered on a point of the camera frame
+        RigidPose<double> randomBoardPose(cv::RNG & rng, const cv::Vec3d & center, const cv::Point3f & boardCenter) {
+            cv::Mat rvec = (cv::Mat_<double>(3, 1) << rng.uniform(-.35, .35), rng.uniform(-.35, .35), rng.uniform(-.2, .2));
+            RigidPose<double> pose(rvec, cv::Mat::zeros(3, 1, CV_64F));
+            cv::Point3d offset = pose.apply(boardCenter.x, boardCenter.y, boardCenter.z);
+            pose.t[0] = center[0] - offset.x;
+            pose.t[1] = center[1] - offset.y;
+            pose.t[2] = center[2] - offset.z;
+            return pose;
+        }
+    }
+
+    CalibrationRegression::Tolerances::Tolerances()
+    :focalLength(0.03)
+    ,principalPoint(30)
+    ,rotationDegrees(1)
+    ,translation(0.15)
+    ,maxReprojErrorCamera(0.5)
+    ,maxReprojErrorProjector(1) {
+    }
+
+    CalibrationRegression::CalibrationRegression() {
+    }
+
+    void CalibrationRegression::setMaxStageTime(const string & stage, float seconds){
+        maxStageTimes[stage] = seconds;
+    }
+
+    bool CalibrationRegression::loadReference(const string & directory, CameraProjectorCalibration & reference){
+        string dir = ofFilePath::addTrailingSlash(directory);
+        string files[3] = {"calibrationCamera.yml", "calibrationProjector.yml", "CameraProjectorExtrinsics.yml"};
+        for(int i = 0; i < 3; i++) {
+            if(!ofFile::doesFileExist(dir + files[i], false)) {
+                ofLogError("CalibrationRegression") << "missing reference file " << dir + files[i];
+                return false;
+            }
+        }
+        reference.getCalibrationCamera().load(dir + files[0], true);
+        reference.getCalibrationProjector().load(dir + files[1], true);
+        reference.loadExtrinsics(dir + files[2], true);
+        return !reference.getCamToProjRotation().empty() && !reference.getCamToProjTranslation().empty();
+    }
+
+    void CalibrationRegression::generateSynthetic(const CameraProjectorCalibration & reference, BatchCalibration & batch,
+                                                  int numBoards, float noise, unsigned long long seed){
+
+        const CameraCalibration & referenceCamera = reference.getCalibrationCamera();
+        const ProjectorCalibration & referenceProjector = reference.getCalibrationProjector();
+        cv::Size cameraSize = referenceCamera.getDistortedIntrinsics().getImageSize();
+        cv::Size projectorSize = referenceProjector.getDistortedIntrinsics().getImageSize();
+        LensModel<double> cameraLens(referenceCamera.getDistortedIntrinsics().getCameraMatrix(), referenceCamera.getDistCoeffs());
+        LensModel<double> projectorLens(referenceProjector.getDistortedIntrinsics().getCameraMatrix(), referenceProjector.getDistCoeffs());
+        RigidPose<double> projToCam = RigidPose<double>(reference.getCamToProjRotation(), reference.getCamToProjTranslation()).inverse();
+        cv::Vec3d projectorCenter(projToCam.t[0], projToCam.t[1], projToCam.t[2]);
+
+        // the printed board & projected pattern of the batch calibration
+        CameraCalibration & calibrationCamera = batch.getCalibration().getCalibrationCamera();
+        ProjectorCalibration & calibrationProjector = batch.getCalibration().getCalibrationProjector();
+        calibrationCamera.setupCandidateObjectPoints();
+        calibrationProjector.setStaticCandidateImagePoints();
+        vector<cv::Point3f> boardPts = calibrationCamera.getCandidateObjectPoints();
+        vector<cv::Point2f> patternPts = calibrationProjector.getCandidateImagePoints();
+        if(boardPts.empty() || patternPts.empty()) return;
+
+        // distances scale with the board, so any square size unit works
+        cv::Point3f boardMin = boardPts[0], boardMax = boardPts[0];
+        for(size_t i = 0; i < boardPts.size(); i++) {
+            boardMin.x = MIN(boardMin.x, boardPts[i].x), boardMin.y = MIN(boardMin.y, boardPts[i].y);
+            boardMax.x = MAX(boardMax.x, boardPts[i].x), boardMax.y = MAX(boardMax.y, boardPts[i].y);
+        }
+        cv::Point3f boardCenter((boardMin.x + boardMax.x) / 2, (boardMin.y + boardMax.y) / 2, 0);
+        double boardWidth = MAX(boardMax.x - boardMin.x, boardMax.y - boardMin.y);
+        cv::Rect patternBounds = cv::boundingRect(patternPts);
+
+        cv::RNG rng(seed);
+        vector<cv::Point2f> chessImgPts, circlesImgPts, projectorImgPts, rays;
+        vector<cv::Point3f> circlesInCam;
+
+        int numCamera = 0;
+        for(int tries = 0; numCamera < numBoards && tries < 1000 * numBoards; tries++) {
+            cv::Vec3d center(rng.uniform(-1.7, 1.7) * boardWidth, rng.uniform(-1.1, 1.1) * boardWidth, rng.uniform(3.5, 7.) * boardWidth);
+            RigidPose<double> boardToCam = randomBoardPose(rng, center, boardCenter);
+            projectToImage(cameraLens, boardToCam, boardPts, chessImgPts);
+            if(!isInside(chessImgPts, cameraSize)) continue;
+            addNoise(chessImgPts, rng, noise);
+            batch.addCameraDetection(chessImgPts, cameraSize);
+            numCamera++;
+        }
+
+        int numProjector = 0;
+        for(int tries = 0; numProjector < numBoards && tries < 1000 * numBoards; tries++) {
+            // the pattern anywhere in the projector image
+            cv::Point2f offset(rng.uniform(0.f, (float) MAX(1, projectorSize.width - patternBounds.width)) - patternBounds.x,
+                               rng.uniform(0.f, (float) MAX(1, projectorSize.height - patternBounds.height)) - patternBounds.y);
+            projectorImgPts.resize(patternPts.size());
+            for(size_t i = 0; i < patternPts.size(); i++) {
+                projectorImgPts[i] = patternPts[i] + offset;
+            }
+
+            // the board where the pattern center lands at a random depth
+            rays.resize(projectorImgPts.size());
+            undistortToRays(projectorLens, &projectorImgPts[0], &rays[0], rays.size());
+            vector<cv::Vec3d> directions(rays.size());
+            cv::Vec3d meanDirection(0, 0, 0);
+            for(size_t i = 0; i < rays.size(); i++) {
+                cv::Point3d d = projToCam.apply(rays[i].x, rays[i].y, 1);
+                directions[i] = cv::Vec3d(d.x, d.y, d.z) - projectorCenter;
+                meanDirection += directions[i];
+            }
+            double depth = rng.uniform(3.5, 7.) * boardWidth;
+            if(meanDirection[2] <= 0) continue;
+            cv::Vec3d center = projectorCenter + meanDirection * ((depth - projectorCenter[2]) / meanDirection[2]);
+            RigidPose<double> boardToCam = randomBoardPose(rng, center, boardCenter);
+
+            // projector rays intersected with the board plane
+            cv::Vec3d normal(boardToCam.r[2], boardToCam.r[5], boardToCam.r[8]);
+            cv::Vec3d origin(boardToCam.t[0], boardToCam.t[1], boardToCam.t[2]);
+            circlesInCam.resize(directions.size());
+            bool bValid = true;
+            for(size_t i = 0; i < directions.size() && bValid; i++) {
+                double s = normal.dot(origin - projectorCenter) / normal.dot(directions[i]);
+                cv::Vec3d pt = projectorCenter + directions[i] * s;
+                circlesInCam[i] = cv::Point3f(pt[0], pt[1], pt[2]);
+                bValid = s > 0 && pt[2] > 0;
+            }
+            if(!bValid) continue;
+
+            projectToImage(cameraLens, boardToCam, boardPts, chessImgPts);
+            projectToImage(cameraLens, RigidPose<double>(), circlesInCam, circlesImgPts);
+            if(!isInside(chessImgPts, cameraSize) || !isInside(circlesImgPts, cameraSize)) continue;
+
+            addNoise(chessImgPts, rng, noise);
+            addNoise(circlesImgPts, rng, noise);
+            batch.addProjectorDetection(chessImgPts, circlesImgPts, cameraSize, projectorImgPts);
+            numProjector++;
+        }
+
+        ofLogNotice("CalibrationRegression") << "synthetic dataset : " << numCamera << " camera boards, "
+                                             << numProjector << " projected patterns, seed " << seed;
+    }
+
+    void CalibrationRegression::checkValue(const string & name, double value, double tolerance){
+        bool bPass = value <= tolerance;
+        stringstream line;
+        line << (bPass ? "ok     " : "FAILED ") << name << " : " << value << " (tolerance " << tolerance << ")";
+        report += line.str() + "\n";
+        if(!bPass) failures.push_back(line.str());
+    }
+
+    void CalibrationRegression::checkIntrinsics(const string & device, const cv::Mat & reference, const cv::Mat & result){
+        cv::Mat_<double> ref, res;
+        reference.convertTo(ref, CV_64F);
+        result.convertTo(res, CV_64F);
+        checkValue(device + " fx", fabs(res(0, 0) / ref(0, 0) - 1), tolerances.focalLength);
+        checkValue(device + " fy", fabs(res(1, 1) / ref(1, 1) - 1), tolerances.focalLength);
+        checkValue(device + " principal point", cv::norm(cv::Point2d(res(0, 2) - ref(0, 2), res(1, 2) - ref(1, 2))),
+                   tolerances.principalPoint);
+    }
+
+    void CalibrationRegression::checkRenderMatrices(const CameraProjectorCalibration & result){
+        const CameraCalibration & calibrationCamera = result.getCalibrationCamera();
+        if(calibrationCamera.getBoardRotations().empty() || calibrationCamera.getObjectPoints().empty()) return;
+
+        // the corners of the last board through the GL matrices and through getProjected :
+        // only the lens distortion, which the matrices can't express, separates them
+        const vector<cv::Point3f> & objectPts = calibrationCamera.getObjectPoints().back();
+        const cv::Mat & boardRot = calibrationCamera.getBoardRotations().back();
+        const cv::Mat & boardTrans = calibrationCamera.getBoardTranslations().back();
+        ProjectorMatrices matrices;
+        matrices.setCalibration(result);
+        matrices.setObjectPose(boardRot, boardTrans);
+        vector<cv::Point2f> glPts;
+        matrices.transform(objectPts, glPts);
+        vector<cv::Point2f> projectedPts = CalibrationSnapshot(result).getProjected(objectPts, boardRot, boardTrans);
+
+        double maxError = 0;
+        for(size_t i = 0; i < glPts.size() && i < projectedPts.size(); i++) {
+            maxError = MAX(maxError, cv::norm(glPts[i] - projectedPts[i]));
+        }
+        checkValue("GL matrices vs getProjected (px)", maxError, matrices.getMaxDistortionError() + 1);
+    }
+
+    bool CalibrationRegression::check(const CameraProjectorCalibration & reference, const BatchCalibration & batch){
+
+        failures.clear();
+        report.clear();
+
+        const CameraProjectorCalibration & result = batch.getCalibration();
+
+        checkIntrinsics("camera",
+                        reference.getCalibrationCamera().getDistortedIntrinsics().getCameraMatrix(),
+                        result.getCalibrationCamera().getDistortedIntrinsics().getCameraMatrix());
+        checkIntrinsics("projector",
+                        reference.getCalibrationProjector().getDistortedIntrinsics().getCameraMatrix(),
+                        result.getCalibrationProjector().getDistortedIntrinsics().getCameraMatrix());
+
+        if(result.getCamToProjRotation().empty() || result.getCamToProjTranslation().empty()) {
+            failures.push_back("no extrinsics");
+            report += "FAILED no extrinsics\n";
+        } else {
+            // angle of the rotation between the two
+            RigidPose<double> referencePose(reference.getCamToProjRotation(), reference.getCamToProjTranslation());
+            RigidPose<double> resultPose(result.getCamToProjRotation(), result.getCamToProjTranslation());
+            RigidPose<double> difference = resultPose.then(referencePose.inverse());
+            double trace = difference.r[0] + difference.r[4] + difference.r[8];
+            checkValue("rotation (degrees)", ofRadToDeg(acos(ofClamp((trace - 1) / 2, -1, 1))), tolerances.rotationDegrees);
+
+            cv::Vec3d referenceTrans(referencePose.t[0], referencePose.t[1], referencePose.t[2]);
+            cv::Vec3d resultTrans(resultPose.t[0], resultPose.t[1], resultPose.t[2]);
+            checkValue("translation", cv::norm(resultTrans - referenceTrans) / MAX(cv::norm(referenceTrans), 1e-9),
+                       tolerances.translation);
+            checkRenderMatrices(result);
+        }
+
+        checkValue("camera reprojection error", result.getCalibrationCamera().getReprojectionError(),
+                   tolerances.maxReprojErrorCamera);
+        checkValue("projector reprojection error", result.getCalibrationProjector().getReprojectionError(),
+                   tolerances.maxReprojErrorProjector);
+
+        const vector<pair<string, float> > & stageTimes = batch.getStageTimes();
+        for(size_t i = 0; i < stageTimes.size(); i++) {
+            map<string, float>::const_iterator maxTime = maxStageTimes.find(stageTimes[i].first);
+            if(maxTime != maxStageTimes.end()) {
+                checkValue(stageTimes[i].first + " time (s)", stageTimes[i].second, maxTime->second);
+            } else {
+                report += "       " + stageTimes[i].first + " time (s) : " + ofToString(stageTimes[i].second, 4) + "\n";
+            }
+        }
+
+        return failures.empty();
+    }
+}
@@ -0,0 +1,67 @@
+/*
+ * ofxCvCalibrationRegression.h
+ *
+ * Accuracy & throughput checks of the batch calibration pipeline : compares
+ * a result to reference calibration files within tolerances, bounds the time
+ * of each stage, and simulates datasets from a reference camera-projector rig.
+ */
+
+#pragma once
+
+#include "ofMain.h"
+#include "ofxCv.h"
+#include "ofxCvBatchCalibration.h"
+
+namespace ofxCv {
+
+    class CalibrationRegression {
+
+    public:
+        // the distortion coefficients are not compared one by one, they trade off
+        // against each other : the reprojection errors bound them instead
+        struct Tolerances {
+            Tolerances();
+            // relative
+            float focalLength;
+            // pixels
+            float principalPoint;
+            float rotationDegrees;
+            // relative to the reference baseline
+            float translation;
+            // RMS pixels, absolute bounds on the result
+            float maxReprojErrorCamera;
+            float maxReprojErrorProjector;
+        };
+
+        CalibrationRegression();
+
+        Tolerances & getTolerances() { return tolerances; }
+        // fails when a BatchCalibration stage (e.g. "stereoCalibrate") takes longer, in seconds
+        void setMaxStageTime(const string & stage, float seconds);
+
+        // calibrationCamera.yml, calibrationProjector.yml & CameraProjectorExtrinsics.yml
+        static bool loadReference(const string & directory, CameraProjectorCalibration & reference);
+
+        // detections of the reference rig seen by a simulated camera : numBoards printed boards,
+        // then numBoards projected patterns at random positions, with gaussian pixel noise.
+        // The same seed always gives the same dataset
+        static void generateSynthetic(const CameraProjectorCalibration & reference, BatchCalibration & batch,
+                                      int numBoards = 30, float noise = 0.1, unsigned long long seed = 0);
+
+        // returns true if every value is within its tolerance and every stage within its time
+        bool check(const CameraProjectorCalibration & reference, const BatchCalibration & batch);
+        const vector<string> & getFailures() const { return failures; }
+        const string & getReport() const { return report; }
+
+    protected:
+        void checkValue(const string & name, double value, double tolerance);
+        void checkIntrinsics(const string & device, const cv::Mat & reference, const cv::Mat & result);
+        // ProjectorMatrices must draw a board corner on the projector pixel getProjected gives
+        void checkRenderMatrices(const CameraProjectorCalibration & result);
+
+        Tolerances tolerances;
+        map<string, float> maxStageTimes;
+        vector<string> failures;
+        string report;
+    };
+}
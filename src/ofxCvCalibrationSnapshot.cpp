@@ -0,0 +1,215 @@
+/*
+ * ofxCvCalibrationSnapshot.cpp
+ *
+ * Immutable copies of a camera-projector calibration, published with an atomic
+ * counter so render threads read the current one without waiting while a
+ * background thread reloads the calibration files when they change on disk.
+ */
+
+#include "ofxCvCalibrationSnapshot.h"
+
+#include <sys/stat.h>
+
+namespace ofxCv {
+
+    namespace {
+        void copyIntrinsics(const Intrinsics & from, Intrinsics & to) {
+            to.setup(from.getCameraMatrix().clone(), from.getImageSize(), from.getSensorSize());
+        }
+    }
+
+#pragma mark - CalibrationSnapshot
+
+    CalibrationSnapshot::CalibrationSnapshot(const CameraProjectorCalibration & calibration, unsigned long version)
+    :version(version) {
+        const CameraCalibration & calibrationCamera = calibration.getCalibrationCamera();
+        const ProjectorCalibration & calibrationProjector = calibration.getCalibrationProjector();
+        copyIntrinsics(calibrationCamera.getDistortedIntrinsics(), cameraIntrinsics);
+        copyIntrinsics(calibrationProjector.getDistortedIntrinsics(), projectorIntrinsics);
+        cameraDistCoeffs = calibrationCamera.getDistCoeffs().clone();
+        projectorDistCoeffs = calibrationProjector.getDistCoeffs().clone();
+        rotCamToProj = calibration.getCamToProjRotation().clone();
+        transCamToProj = calibration.getCamToProjTranslation().clone();
+        setupKernels();
+    }
+
+    CalibrationSnapshot * CalibrationSnapshot::load(string cameraConfig, string projectorConfig, string extrinsicsConfig,
+                                                    unsigned long version, bool absolute){
+
+        if(!ofFile::doesFileExist(cameraConfig, !absolute) ||
+           !ofFile::doesFileExist(projectorConfig, !absolute) ||
+           !ofFile::doesFileExist(extrinsicsConfig, !absolute)) {
+            return NULL;
+        }
+
+        CalibrationSnapshot * snapshot = new CalibrationSnapshot();
+        snapshot->version = version;
+        try {
+            Calibration calibrationCamera, calibrationProjector;
+            calibrationCamera.load(cameraConfig, absolute);
+            calibrationProjector.load(projectorConfig, absolute);
+            copyIntrinsics(calibrationCamera.getDistortedIntrinsics(), snapshot->cameraIntrinsics);
+            copyIntrinsics(calibrationProjector.getDistortedIntrinsics(), snapshot->projectorIntrinsics);
+            snapshot->cameraDistCoeffs = calibrationCamera.getDistCoeffs().clone();
+            snapshot->projectorDistCoeffs = calibrationProjector.getDistCoeffs().clone();
+
+            cv::FileStorage fs(ofToDataPath(extrinsicsConfig, absolute), cv::FileStorage::READ);
+            fs["Rotation_Vector"] >> snapshot->rotCamToProj;
+            fs["Translation_Vector"] >> snapshot->transCamToProj;
+        } catch(cv::Exception & e) {
+            ofLogError("CalibrationSnapshot") << "can't read the calibration : " << e.what();
+            delete snapshot;
+            return NULL;
+        }
+
+        if(snapshot->rotCamToProj.empty() || snapshot->transCamToProj.empty()) {
+            delete snapshot;
+            return NULL;
+        }
+        snapshot->setupKernels();
+        return snapshot;
+    }
+
+    void CalibrationSnapshot::setupKernels(){
+        if(rotCamToProj.empty() || transCamToProj.empty()) return;
+        projectorLens = LensModel<float>(projectorIntrinsics.getCameraMatrix(), projectorDistCoeffs);
+        camToProj = RigidPose<float>(rotCamToProj, transCamToProj);
+    }
+
+    vector<Point2f> CalibrationSnapshot::getProjected(const vector<Point3f> & pts,
+                                                      const cv::Mat & rotObjToCam,
+                                                      const cv::Mat & transObjToCam) const {
+        RigidPose<float> objToProj = RigidPose<float>(rotObjToCam, transObjToCam).then(camToProj);
+
+        vector<Point2f> out;
+        projectToImage(projectorLens, objToProj, pts, out);
+        return out;
+    }
+
+    vector<Point2f> CalibrationSnapshot::getProjected(const vector<Point3f> & pts,
+                                                      const PosePredictor & predictor) const {
+        cv::Mat rotObjToCam, transObjToCam;
+        if(!predictor.predict(rotObjToCam, transObjToCam)) {
+            return vector<Point2f>();
+        }
+        return getProjected(pts, rotObjToCam, transObjToCam);
+    }
+
+#pragma mark - CalibrationStore::Reader
+
+    CalibrationStore::Reader::Reader()
+    :store(NULL)
+    ,publishCount(0) {
+    }
+
+    void CalibrationStore::Reader::setup(const CalibrationStore & store){
+        this->store = &store;
+        snapshot.reset();
+        publishCount = 0;
+    }
+
+    const std::shared_ptr<const CalibrationSnapshot> & CalibrationStore::Reader::get(){
+        if(store != NULL && store->publishCount.load(std::memory_order_acquire) != publishCount) {
+            std::lock_guard<std::mutex> lock(store->currentMutex);
+            snapshot = store->current;
+            publishCount = store->publishCount.load(std::memory_order_relaxed);
+        }
+        return snapshot;
+    }
+
+#pragma mark - CalibrationStore
+
+    CalibrationStore::CalibrationStore()
+    :publishCount(0)
+    ,lastVersion(0)
+    ,pollInterval(1) {
+    }
+
+    CalibrationStore::~CalibrationStore(){
+        stopWatching();
+    }
+
+    std::shared_ptr<const CalibrationSnapshot> CalibrationStore::get() const {
+        std::lock_guard<std::mutex> lock(currentMutex);
+        return current;
+    }
+
+    unsigned long CalibrationStore::getVersion() const {
+        std::shared_ptr<const CalibrationSnapshot> snapshot = get();
+        return snapshot ? snapshot->getVersion() : 0;
+    }
+
+    void CalibrationStore::publish(CalibrationSnapshot * snapshot){
+        if(snapshot == NULL) return;
+        ofLogVerbose("CalibrationStore") << "publishing calibration version " << snapshot->getVersion();
+        std::shared_ptr<const CalibrationSnapshot> replaced(snapshot);
+        {
+            std::lock_guard<std::mutex> lock(currentMutex);
+            current.swap(replaced);
+            publishCount.fetch_add(1, std::memory_order_release);
+        }
+        // the previous snapshot, if no reader holds it, is freed outside of the lock
+    }
+
+    void CalibrationStore::publish(const CameraProjectorCalibration & calibration){
+        publish(new CalibrationSnapshot(calibration, ++lastVersion));
+    }
+
+    void CalibrationStore::watch(string cameraConfig, string projectorConfig, string extrinsicsConfig, double pollInterval){
+        stopWatching();
+        this->cameraConfig = ofToDataPath(cameraConfig, false);
+        this->projectorConfig = ofToDataPath(projectorConfig, false);
+        this->extrinsicsConfig = ofToDataPath(extrinsicsConfig, false);
+        this->pollInterval = pollInterval;
+        startThread(true, false);
+    }
+
+    void CalibrationStore::stopWatching(){
+        if(isThreadRunning()) {
+            waitForThread(true);
+        }
+    }
+
+    string CalibrationStore::getFilesStamp() const {
+        string stamp;
+        const string * files[] = { &cameraConfig, &projectorConfig, &extrinsicsConfig };
+        for(int i = 0; i < 3; i++) {
+            struct stat info;
+            if(stat(files[i]->c_str(), &info) != 0) return "";
+            stamp += ofToString(info.st_mtime) + ":" + ofToString(info.st_size) + ";";
+        }
+        return stamp;
+    }
+
+    void CalibrationStore::threadedFunction(){
+
+        // the files as they are now are considered published already
+        string loadedStamp = get() ? getFilesStamp() : "";
+        string previousStamp = loadedStamp;
+
+        while(isThreadRunning()) {
+
+            string stamp = getFilesStamp();
+
+            // reloads once the files didn't change for a whole poll, so they're not half written
+            if(!stamp.empty() && stamp != loadedStamp && stamp == previousStamp) {
+                unsigned long version = ++lastVersion;
+                CalibrationSnapshot * snapshot = CalibrationSnapshot::load(cameraConfig, projectorConfig, extrinsicsConfig,
+                                                                           version, true);
+                if(snapshot != NULL) {
+                    publish(snapshot);
+                    ofLogNotice("CalibrationStore") << "calibration reloaded, version " << version;
+                } else {
+                    ofLogWarning("CalibrationStore") << "can't reload the calibration, keeping version " << getVersion();
+                }
+                loadedStamp = stamp;
+            }
+            previousStamp = stamp;
+
+            double endTime = ofGetElapsedTimef() + pollInterval;
+            while(isThreadRunning() && ofGetElapsedTimef() < endTime) {
+                sleep(MIN(50, MAX(1, (long) ((endTime - ofGetElapsedTimef()) * 1000))));
+            }
+        }
+    }
+}
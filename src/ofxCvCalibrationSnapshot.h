@@ -0,0 +1,111 @@
+/*
+ * ofxCvCalibrationSnapshot.h
+ *
+ * Immutable copies of a camera-projector calibration, published with an atomic
+ * counter so render threads read the current one without waiting while a
+ * background thread reloads the calibration files when they change on disk.
+ */
+
+#pragma once
+
+#include "ofMain.h"
+#include "ofxCv.h"
+#include "ofxCvCameraProjectorCalibration.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+namespace ofxCv {
+
+#pragma mark - CalibrationSnapshot
+
+    class CalibrationSnapshot {
+
+    public:
+        CalibrationSnapshot(const CameraProjectorCalibration & calibration, unsigned long version = 0);
+        // NULL if one of the files can't be read
+        static CalibrationSnapshot * load(string cameraConfig, string projectorConfig, string extrinsicsConfig,
+                                          unsigned long version = 0, bool absolute = false);
+
+        unsigned long getVersion() const { return version; }
+        const Intrinsics & getCameraIntrinsics() const { return cameraIntrinsics; }
+        const Intrinsics & getProjectorIntrinsics() const { return projectorIntrinsics; }
+        const cv::Mat & getCameraDistCoeffs() const { return cameraDistCoeffs; }
+        const cv::Mat & getProjectorDistCoeffs() const { return projectorDistCoeffs; }
+        const cv::Mat & getCamToProjRotation() const { return rotCamToProj; }
+        const cv::Mat & getCamToProjTranslation() const { return transCamToProj; }
+
+        // float kernels, see CameraProjectorCalibration::checkKernelAccuracy for their error
+        vector<Point2f> getProjected(const vector<Point3f> & ptsInWorld,
+                                     const cv::Mat & rotObjToCam = Mat::zeros(3, 1, CV_64F),
+                                     const cv::Mat & transObjToCam = Mat::zeros(3, 1, CV_64F)) const;
+        vector<Point2f> getProjected(const vector<Point3f> & ptsInWorld,
+                                     const PosePredictor & predictor) const;
+
+    protected:
+        CalibrationSnapshot() {}
+        void setupKernels();
+
+        unsigned long version;
+        Intrinsics cameraIntrinsics, projectorIntrinsics;
+        cv::Mat cameraDistCoeffs, projectorDistCoeffs;
+        cv::Mat rotCamToProj, transCamToProj;
+        LensModel<float> projectorLens;
+        RigidPose<float> camToProj;
+    };
+
+#pragma mark - CalibrationStore
+
+    class CalibrationStore : public ofThread {
+
+    public:
+        // one per reading thread (e.g. the render thread) : get() only reads an atomic
+        // counter, and copies the new snapshot under the store mutex once per publish
+        class Reader {
+        public:
+            Reader();
+            void setup(const CalibrationStore & store);
+            // empty until something is published, valid until the next get() of this reader
+            const std::shared_ptr<const CalibrationSnapshot> & get();
+
+        protected:
+            const CalibrationStore * store;
+            std::shared_ptr<const CalibrationSnapshot> snapshot;
+            unsigned long publishCount;
+        };
+
+        CalibrationStore();
+        ~CalibrationStore();
+
+        // takes the store mutex, a Reader doesn't. The snapshot stays valid as long
+        // as the returned pointer is held
+        std::shared_ptr<const CalibrationSnapshot> get() const;
+        unsigned long getVersion() const;
+
+        // takes ownership, can be called from any thread
+        void publish(CalibrationSnapshot * snapshot);
+        void publish(const CameraProjectorCalibration & calibration);
+
+        // reloads & publishes the calibration on a background thread when one of the files changes
+        void watch(string cameraConfig = "calibrationCamera.yml",
+                   string projectorConfig = "calibrationProjector.yml",
+                   string extrinsicsConfig = "CameraProjectorExtrinsics.yml",
+                   double pollInterval = 1);
+        void stopWatching();
+
+    protected:
+        void threadedFunction();
+        string getFilesStamp() const;
+
+        // guarded by currentMutex, the replaced snapshot is freed by its last reader.
+        // publishCount changes after current, under the mutex too
+        std::shared_ptr<const CalibrationSnapshot> current;
+        mutable std::mutex currentMutex;
+        std::atomic<unsigned long> publishCount;
+        std::atomic<unsigned long> lastVersion;
+
+        string cameraConfig, projectorConfig, extrinsicsConfig;
+        double pollInterval;
+    };
+}
@@ -0,0 +1,209 @@
+/*
+ * ofxCvCalibrationUncertainty.cpp
+ *
+ * Parameter covariance of the camera / projector intrinsics and of the
+ * camera -> projector extrinsics, computed from the projection Jacobians at
+ * the solution (no re-solve). Each board contributes a small block that is
+ * cached : while the intrinsics stay the same, adding or removing a board only
+ * costs that board.
+ */
+
+#include "ofxCvCalibrationUncertainty.h"
+
+namespace ofxCv {
+
+    namespace {
+        double getSquaredError(const vector<Point2f> & a, const vector<Point2f> & b) {
+            double sum = 0;
+            for(size_t i = 0; i < a.size() && i < b.size(); i++) {
+                Point2f d = a[i] - b[i];
+                sum += d.dot(d);
+            }
+            return sum;
+        }
+
+        cv::Vec<double, 6> getPoseKey(const cv::Mat & boardRot, const cv::Mat & boardTrans) {
+            cv::Mat rot64, trans64;
+            boardRot.convertTo(rot64, CV_64F);
+            boardTrans.convertTo(trans64, CV_64F);
+            cv::Vec<double, 6> key = cv::Vec<double, 6>::all(0);
+            for(int i = 0; i < 3 && i < (int) rot64.total(); i++) key[i] = rot64.ptr<double>()[i];
+            for(int i = 0; i < 3 && i < (int) trans64.total(); i++) key[3 + i] = trans64.ptr<double>()[i];
+            return key;
+        }
+
+        bool isSame(const cv::Mat & a, const cv::Mat & b) {
+            if(a.total() != b.total()) return false;
+            if(a.empty()) return true;
+            cv::Mat a64, b64;
+            a.convertTo(a64, CV_64F);
+            b.convertTo(b64, CV_64F);
+            return cv::norm(a64.reshape(1, 1), b64.reshape(1, 1), cv::NORM_INF) == 0;
+        }
+
+        cv::Mat getStdDevFromCovariance(const cv::Mat & covariance) {
+            if(covariance.empty()) return cv::Mat();
+            cv::Mat stdDev;
+            cv::sqrt(cv::max(covariance.diag(), 0), stdDev);
+            return stdDev;
+        }
+    }
+
+    int getNumIntrinsicParams(const cv::Mat & distCoeffs){
+        return 4 + MIN((int) distCoeffs.total(), 5);
+    }
+
+    BoardInformation computeBoardInformation(const vector<Point3f> & objectPoints,
+                                             const vector<Point2f> & imagePoints,
+                                             const cv::Mat & boardRot, const cv::Mat & boardTrans,
+                                             const cv::Mat & cameraMatrix, const cv::Mat & distCoeffs){
+        int numParams = getNumIntrinsicParams(distCoeffs);
+
+        vector<Point2f> projected;
+        cv::Mat jacobian;
+        cv::projectPoints(cv::Mat(objectPoints), boardRot, boardTrans,
+                          cameraMatrix, distCoeffs, projected, jacobian);
+
+        // columns are [rot trans | fx fy cx cy dist...]
+        cv::Mat jacobianPose = jacobian.colRange(0, 6);
+        cv::Mat jacobianIntrinsics = jacobian.colRange(6, 6 + numParams);
+
+        cv::Mat ipp = jacobianPose.t() * jacobianPose;
+        cv::Mat ipk = jacobianPose.t() * jacobianIntrinsics;
+        cv::Mat ikk = jacobianIntrinsics.t() * jacobianIntrinsics;
+
+        BoardInformation board;
+        board.information = ikk - ipk.t() * ipp.inv(cv::DECOMP_CHOLESKY) * ipk;
+        board.numResiduals = 2 * objectPoints.size();
+        board.squaredError = getSquaredError(projected, imagePoints);
+        return board;
+    }
+
+#pragma mark - IntrinsicsUncertainty
+
+    IntrinsicsUncertainty::IntrinsicsUncertainty(){
+    }
+
+    void IntrinsicsUncertainty::setup(const cv::Mat & cameraMatrix, const cv::Mat & distCoeffs){
+        this->cameraMatrix = cameraMatrix.clone();
+        this->distCoeffs = distCoeffs.clone();
+        boards.clear();
+    }
+
+    void IntrinsicsUncertainty::add(const vector<Point3f> & objectPoints, const vector<Point2f> & imagePoints,
+                                    const cv::Mat & boardRot, const cv::Mat & boardTrans){
+        boards.push_back(computeBoardInformation(objectPoints, imagePoints, boardRot, boardTrans,
+                                                 cameraMatrix, distCoeffs));
+        boards.back().pose = getPoseKey(boardRot, boardTrans);
+    }
+
+    int IntrinsicsUncertainty::update(const cv::Mat & cameraMatrix, const cv::Mat & distCoeffs,
+                                      const vector<vector<Point3f> > & objectPoints, const vector<vector<Point2f> > & imagePoints,
+                                      const vector<cv::Mat> & boardRotations, const vector<cv::Mat> & boardTranslations){
+        if(!isSame(cameraMatrix, this->cameraMatrix) || !isSame(distCoeffs, this->distCoeffs)) {
+            setup(cameraMatrix, distCoeffs);
+        }
+
+        int n = MIN(MIN(objectPoints.size(), imagePoints.size()), MIN(boardRotations.size(), boardTranslations.size()));
+        vector<BoardInformation> cached;
+        cached.swap(boards);
+        int numComputed = 0;
+        size_t next = 0;
+        for(int i = 0; i < n; i++) {
+            cv::Vec<double, 6> pose = getPoseKey(boardRotations[i], boardTranslations[i]);
+            size_t match = next;
+            while(match < cached.size() && cached[match].pose != pose) match++;
+            if(match < cached.size()) {
+                boards.push_back(cached[match]);
+                next = match + 1;
+            } else {
+                add(objectPoints[i], imagePoints[i], boardRotations[i], boardTranslations[i]);
+                numComputed++;
+            }
+        }
+        return numComputed;
+    }
+
+    void IntrinsicsUncertainty::remove(int index){
+        boards.erase(boards.begin() + index);
+    }
+
+    double IntrinsicsUncertainty::getResidualStdDev() const {
+        double squaredError = 0;
+        int dof = -getNumIntrinsicParams(distCoeffs);
+        for(size_t i = 0; i < boards.size(); i++) {
+            squaredError += boards[i].squaredError;
+            dof += boards[i].numResiduals - 6;
+        }
+        return dof > 0 ? sqrt(squaredError / dof) : 0;
+    }
+
+    cv::Mat IntrinsicsUncertainty::getCovariance() const {
+        if(boards.empty()) return cv::Mat();
+
+        cv::Mat information = cv::Mat::zeros(boards[0].information.size(), CV_64F);
+        for(size_t i = 0; i < boards.size(); i++) {
+            information += boards[i].information;
+        }
+        double sigma = getResidualStdDev();
+        return information.inv(cv::DECOMP_SVD) * (sigma * sigma);
+    }
+
+    cv::Mat IntrinsicsUncertainty::getStdDev() const {
+        return getStdDevFromCovariance(getCovariance());
+    }
+
+#pragma mark - ExtrinsicsUncertainty
+
+    ExtrinsicsUncertainty::ExtrinsicsUncertainty(){
+    }
+
+    void ExtrinsicsUncertainty::setup(const cv::Mat & rotCamToProj, const cv::Mat & transCamToProj,
+                                      const cv::Mat & projectorMatrix, const cv::Mat & projectorDistCoeffs){
+        this->rotCamToProj = rotCamToProj.clone();
+        this->transCamToProj = transCamToProj.clone();
+        this->projectorMatrix = projectorMatrix.clone();
+        this->projectorDistCoeffs = projectorDistCoeffs.clone();
+        boards.clear();
+    }
+
+    void ExtrinsicsUncertainty::add(const vector<Point3f> & ptsInCam, const vector<Point2f> & imagePoints){
+        vector<Point2f> projected;
+        cv::Mat jacobian;
+        cv::projectPoints(cv::Mat(ptsInCam), rotCamToProj, transCamToProj,
+                          projectorMatrix, projectorDistCoeffs, projected, jacobian);
+
+        cv::Mat jacobianPose = jacobian.colRange(0, 6);
+
+        BoardInformation board;
+        board.information = jacobianPose.t() * jacobianPose;
+        board.numResiduals = 2 * ptsInCam.size();
+        board.squaredError = getSquaredError(projected, imagePoints);
+        boards.push_back(board);
+    }
+
+    double ExtrinsicsUncertainty::getResidualStdDev() const {
+        double squaredError = 0;
+        int dof = -6;
+        for(size_t i = 0; i < boards.size(); i++) {
+            squaredError += boards[i].squaredError;
+            dof += boards[i].numResiduals;
+        }
+        return dof > 0 ? sqrt(squaredError / dof) : 0;
+    }
+
+    cv::Mat ExtrinsicsUncertainty::getCovariance() const {
+        if(boards.empty()) return cv::Mat();
+
+        cv::Mat information = cv::Mat::zeros(6, 6, CV_64F);
+        for(size_t i = 0; i < boards.size(); i++) {
+            information += boards[i].information;
+        }
+        double sigma = getResidualStdDev();
+        return information.inv(cv::DECOMP_SVD) * (sigma * sigma);
+    }
+
+    cv::Mat ExtrinsicsUncertainty::getStdDev() const {
+        return getStdDevFromCovariance(getCovariance());
+    }
+}
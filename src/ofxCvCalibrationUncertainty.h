@@ -0,0 +1,92 @@
+/*
+ * ofxCvCalibrationUncertainty.h
+ *
+ * Parameter covariance of the camera / projector intrinsics and of the
+ * camera -> projector extrinsics, computed from the projection Jacobians at
+ * the solution (no re-solve). Each board contributes a small block that is
+ * cached : while the intrinsics stay the same, adding or removing a board only
+ * costs that board.
+ */
+
+#pragma once
+
+#include "ofMain.h"
+#include "ofxCv.h"
+
+namespace ofxCv {
+
+    // normal equations of a single board
+    struct BoardInformation {
+        BoardInformation() : squaredError(0), numResiduals(0) {}
+        cv::Mat information;
+        double squaredError;
+        int numResiduals;
+        // rotation & translation the block was computed at
+        cv::Vec<double, 6> pose;
+    };
+
+    // [fx fy cx cy dist...] block of J^t J with the board pose marginalized out (Schur complement),
+    // imagePoints may be empty when only the information is needed (e.g. for a candidate pose)
+    BoardInformation computeBoardInformation(const vector<Point3f> & objectPoints,
+                                             const vector<Point2f> & imagePoints,
+                                             const cv::Mat & boardRot, const cv::Mat & boardTrans,
+                                             const cv::Mat & cameraMatrix, const cv::Mat & distCoeffs);
+
+    // number of intrinsic parameters estimated for these distortion coefficients
+    int getNumIntrinsicParams(const cv::Mat & distCoeffs);
+
+#pragma mark - IntrinsicsUncertainty
+
+    class IntrinsicsUncertainty {
+
+    public:
+        IntrinsicsUncertainty();
+
+        void setup(const cv::Mat & cameraMatrix, const cv::Mat & distCoeffs);
+        void add(const vector<Point3f> & objectPoints, const vector<Point2f> & imagePoints,
+                 const cv::Mat & boardRot, const cv::Mat & boardTrans);
+        void remove(int index);
+        int size() const { return boards.size(); }
+
+        // brings the blocks in line with the boards : with the same intrinsics, the block of a
+        // board still at the same pose is kept (boards are only appended or erased, so they
+        // are matched in order), the others are computed. New intrinsics rebuild every block.
+        // Returns the number of blocks computed
+        int update(const cv::Mat & cameraMatrix, const cv::Mat & distCoeffs,
+                   const vector<vector<Point3f> > & objectPoints, const vector<vector<Point2f> > & imagePoints,
+                   const vector<cv::Mat> & boardRotations, const vector<cv::Mat> & boardTranslations);
+
+        // covariance of [fx fy cx cy k1 k2 p1 p2 k3], scaled by the residual variance
+        cv::Mat getCovariance() const;
+        cv::Mat getStdDev() const;
+        double getResidualStdDev() const;
+
+    protected:
+        cv::Mat cameraMatrix, distCoeffs;
+        vector<BoardInformation> boards;
+    };
+
+#pragma mark - ExtrinsicsUncertainty
+
+    class ExtrinsicsUncertainty {
+
+    public:
+        ExtrinsicsUncertainty();
+
+        void setup(const cv::Mat & rotCamToProj, const cv::Mat & transCamToProj,
+                   const cv::Mat & projectorMatrix, const cv::Mat & projectorDistCoeffs);
+        // ptsInCam : board points in the camera reference frame, imagePoints : projector pixels
+        void add(const vector<Point3f> & ptsInCam, const vector<Point2f> & imagePoints);
+        int size() const { return boards.size(); }
+
+        // covariance of [rot_x rot_y rot_z trans_x trans_y trans_z]
+        cv::Mat getCovariance() const;
+        cv::Mat getStdDev() const;
+        double getResidualStdDev() const;
+
+    protected:
+        cv::Mat rotCamToProj, transCamToProj;
+        cv::Mat projectorMatrix, projectorDistCoeffs;
+        vector<BoardInformation> boards;
+    };
+}
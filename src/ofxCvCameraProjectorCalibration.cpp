@@ -14,6 +14,45 @@
 namespace ofxCv {
     
     
+#pragma mark - CalibrationPatched
+    
+    
+    void CalibrationPatched::updateUncertainty(){
+        if(distCoeffs.empty()) {
+            uncertainty.setup(distortedIntrinsics.getCameraMatrix(), distCoeffs);
+            return;
+        }
+        uncertainty.update(distortedIntrinsics.getCameraMatrix(), distCoeffs,
+                           objectPoints, imagePoints, boardRotations, boardTranslations);
+    }
+    
+    bool CalibrationPatched::detectBoard(const cv::Mat & img, vector<cv::Point2f> & pointBuf) const {
+        
+        if(patternType == CHESSBOARD) {
+            bool found = findChessboardCorners(img, patternSize, pointBuf, CV_CALIB_CB_ADAPTIVE_THRESH);
+            if(found) {
+                cv::Mat gray;
+                if(img.channels() == 3) cvtColor(img, gray, CV_RGB2GRAY);
+                else if(img.channels() == 4) cvtColor(img, gray, CV_RGBA2GRAY);
+                else gray = img;
+                cornerSubPix(gray, pointBuf, subpixelSize, cv::Size(-1,-1),
+                             cv::TermCriteria(CV_TERMCRIT_EPS + CV_TERMCRIT_ITER, 30, 0.1));
+            }
+            return found;
+        }
+        int flags = (patternType == CIRCLES_GRID ? cv::CALIB_CB_SYMMETRIC_GRID : cv::CALIB_CB_ASYMMETRIC_GRID);
+        return findCirclesGrid(img, patternSize, pointBuf, flags);
+    }
+    
+    void CalibrationPatched::updateIntrinsics(const cv::Mat & cameraMatrix, const cv::Mat & distCoeffs){
+        distortedIntrinsics.setup(cameraMatrix.clone(), distortedIntrinsics.getImageSize());
+        this->distCoeffs = distCoeffs.clone();
+        updateUndistortion();
+        updateReprojectionError();
+        updateUncertainty();
+    }
+    
+    
 #pragma mark - CameraCalibration
     
     
@@ -33,7 +72,16 @@ namespace ofxCv {
                      boardRot, boardTrans);
     }
     
-    // some crazy stuff, no idea what's happening there. So thanks Alvaro & Niklas!
+    const UndistortionMap & CameraCalibration::getUndistortionMap(){
+        const cv::Mat & cameraMatrix = distortedIntrinsics.getCameraMatrix();
+        cv::Size imageSize = distortedIntrinsics.getImageSize();
+        if(imageSize.area() == 0) imageSize = addedImageSize;
+        if(!undistortionMap.matches(cameraMatrix, distCoeffs, imageSize)) {
+            undistortionMap.setup(cameraMatrix, distCoeffs, imageSize);
+        }
+        return undistortionMap;
+    }
+    
     bool CameraCalibration::backProject(const Mat& boardRot64,
                                         const Mat& boardTrans64,
                                         const vector<Point2f>& imgPt,
@@ -41,43 +89,13 @@ namespace ofxCv {
         if( imgPt.size() == 0 ) {
             return false;
         }
-        else
-        {
-            Mat imgPt_h = Mat::zeros(3, imgPt.size(), CV_32F);
-            for( int h=0; h<imgPt.size(); ++h ) {
-                imgPt_h.at<float>(0,h) = imgPt[h].x;
-                imgPt_h.at<float>(1,h) = imgPt[h].y;
-                imgPt_h.at<float>(2,h) = 1.0f;
-            }
-            Mat Kinv64 = getUndistortedIntrinsics().getCameraMatrix().inv();
-            Mat Kinv,boardRot,boardTrans;
-            Kinv64.convertTo(Kinv, CV_32F);
-            boardRot64.convertTo(boardRot, CV_32F);
-            boardTrans64.convertTo(boardTrans, CV_32F);
-            
-            // Transform all image points to world points in camera reference frame
-            // and then into the plane reference frame
-            Mat worldImgPt = Mat::zeros( 3, imgPt.size(), CV_32F );
-            Mat rot3x3;
-            Rodrigues(boardRot, rot3x3);
-            
-            Mat transPlaneToCam = rot3x3.inv()*boardTrans;
-            
-            for( int i=0; i<imgPt.size(); ++i ) {
-                Mat col = imgPt_h.col(i);
-                Mat worldPtcam = Kinv*col;
-                Mat worldPtPlane = rot3x3.inv()*(worldPtcam);
-                
-                float scale = transPlaneToCam.at<float>(2)/worldPtPlane.at<float>(2);
-                Mat worldPtPlaneReproject = scale*worldPtPlane-transPlaneToCam;
-                
-                Point3f pt;
-                pt.x = worldPtPlaneReproject.at<float>(0);
-                pt.y = worldPtPlaneReproject.at<float>(1);
-                pt.z = 0;
-                worldPt.push_back(pt);
-            }
-        }
+        // undistorted rays, consistent with the board pose from computeCandidateBoardPose,
+        // intersected with the board plane in double precision
+        vector<Point2f> rays;
+        getUndistortionMap().undistort(imgPt, rays);
+        size_t offset = worldPt.size();
+        worldPt.resize(offset + rays.size());
+        backProjectToPlane(RigidPose<double>(boardRot64, boardTrans64), &rays[0], &worldPt[offset], rays.size());
         return true;
     }
     
@@ -115,6 +133,33 @@ namespace ofxCv {
     
 #pragma mark - CameraProjectorCalibration
     
+    CameraProjectorCalibration::Settings::Settings()
+    :diffMinBetweenFrames(4.0)
+    ,timeMinBetweenCaptures(2.0)
+    ,numBoardsFinalCamera(20)
+    ,numBoardsFinalProjector(12)
+    ,numBoardsBeforeCleaning(8)
+    ,numBoardsBeforeDynamicProjection(5)
+    ,maxReprojErrorCamera(0.2)
+    ,maxReprojErrorProjector(0.6)
+    ,targetStdDevCamera(1.0)
+    ,targetStdDevProjector(2.0)
+    ,circleDetectionThreshold(220)
+    ,maxBoardsInMemory(0)
+    ,maxPointsPerBoard(0)
+    ,bSaveResults(true)
+    ,cameraConfig("calibrationCamera.yml")
+    ,projectorConfig("calibrationProjector.yml")
+    ,extrinsicsConfig("CameraProjectorExtrinsics.yml") {
+    }
+    
+    CameraProjectorCalibration::CameraProjectorCalibration()
+    :state(PROJECTOR_STATIC)
+    ,diffMean(0)
+    ,lastCaptureTime(0)
+    ,bBoardSelection(false) {
+    }
+    
     void CameraProjectorCalibration::load(string cameraConfig, string projectorConfig, string extrinsicsConfig){
         calibrationCamera.load(cameraConfig);
         calibrationProjector.load(projectorConfig);
@@ -132,8 +177,399 @@ namespace ofxCv {
         calibrationProjector.setPatternPosition(500, 250);
         calibrationProjector.setSquareSize(40);
         calibrationProjector.setPatternType(ASYMMETRIC_CIRCLES_GRID);
+        
+        projectorBoardSelector.setup(cv::Size(projectorWidth, projectorHeight));
     }
 
+#pragma mark - streaming calibration
+    
+    string CameraProjectorCalibration::getStateName(State state){
+        switch (state) {
+            case CAMERA:            return "CAMERA";
+            case PROJECTOR_STATIC:  return "PROJECTOR_STATIC";
+            case PROJECTOR_DYNAMIC: return "PROJECTOR_DYNAMIC";
+            case FINISHED:          return "FINISHED";
+            default: return "";
+        }
+    }
+    
+    void CameraProjectorCalibration::notify(Event::Type type, const string & message, float reprojError){
+        Event e;
+        e.type = type;
+        e.state = state;
+        e.numBoards = state == CAMERA ? calibrationCamera.size() : calibrationProjector.size();
+        e.reprojError = reprojError;
+        e.message = message;
+        eventLog.push(e.type, e.state, e.numBoards, e.reprojError, e.message);
+        ofNotifyEvent(calibrationEvent, e, this);
+    }
+    
+    string CameraProjectorCalibration::getEventTypeName(Event::Type type){
+        switch (type) {
+            case Event::STATE_CHANGED:  return "STATE_CHANGED";
+            case Event::BOARD_ACCEPTED: return "BOARD_ACCEPTED";
+            case Event::BOARD_REJECTED: return "BOARD_REJECTED";
+            case Event::BOARDS_CLEANED: return "BOARDS_CLEANED";
+            case Event::SOLVED:         return "SOLVED";
+            case Event::SAVED:          return "SAVED";
+            case Event::MESSAGE:        return "MESSAGE";
+            default: return "";
+        }
+    }
+    
+    bool CameraProjectorCalibration::exportEventLog(const string & path, bool absolute) const {
+        vector<string> typeNames, stateNames;
+        for(int i = Event::STATE_CHANGED; i <= Event::MESSAGE; i++) {
+            typeNames.push_back(getEventTypeName((Event::Type) i));
+        }
+        for(int i = CAMERA; i <= FINISHED; i++) {
+            stateNames.push_back(getStateName((State) i));
+        }
+        return eventLog.exportCsv(path, typeNames, stateNames, absolute);
+    }
+    
+    void CameraProjectorCalibration::setState(State newState){
+        
+        // like the original example, the projector stage starts from the saved camera
+        // calibration. Without bSaveResults the file isn't newer than the calibration
+        // in memory, which enterState then only loads when there's none
+        if(newState == PROJECTOR_STATIC && settings.bSaveResults) {
+            calibrationCamera.load(settings.cameraConfig);
+        }
+        enterState(newState);
+        
+        Observation observation;
+        observation.type = Observation::STATE;
+        observation.state = state;
+        observationLog.append(observation);
+        
+        notify(Event::STATE_CHANGED, "Set state : " + getStateName(state));
+    }
+    
+    void CameraProjectorCalibration::enterState(State newState){
+        
+        switch (newState) {
+            case CAMERA:
+                resetBoards();
+                calibrationCamera.setupCandidateObjectPoints();
+                break;
+            case PROJECTOR_STATIC:
+                // a replay keeps the camera solved from its logged boards
+                if(!calibrationCamera.isReady()) {
+                    calibrationCamera.load(settings.cameraConfig);
+                }
+                resetBoards();
+                calibrationCamera.setupCandidateObjectPoints();
+                calibrationProjector.setStaticCandidateImagePoints();
+                break;
+            case PROJECTOR_DYNAMIC:
+                captureScheduler.consume();
+                break;
+            default:
+                break;
+        }
+        state = newState;
+    }
+    
+    bool CameraProjectorCalibration::openSession(const string & path, bool bResume){
+        
+        vector<Observation> observations;
+        if(bResume) {
+            ObservationLog::read(path, observations);
+        }
+        if(!observationLog.open(path)) {
+            return false;
+        }
+        if(observations.empty()) {
+            observationLog.clear();
+            return false;
+        }
+        
+        float startTime = ofGetElapsedTimef();
+        replay(observations);
+        
+        notify(Event::STATE_CHANGED, "Resumed session at state " + getStateName(state) + " from "
+               + ofToString(observations.size()) + " records in " + ofToString(ofGetElapsedTimef() - startTime, 3) + "s");
+        return true;
+    }
+    
+    void CameraProjectorCalibration::replay(const vector<Observation> & observations){
+        
+        cv::Size cameraImageSize;
+        for(size_t i = 0; i < observations.size(); i++) {
+            const Observation & observation = observations[i];
+            switch (observation.type) {
+                    
+                case Observation::STATE:
+                    // the camera calibration was solved then saved before leaving the camera stage
+                    if(observation.state == PROJECTOR_STATIC && state == CAMERA && calibrationCamera.size() > 0) {
+                        calibrationCamera.calibrateWithUncertainty();
+                        calibrationCamera.cleanWithUncertainty(settings.maxReprojErrorCamera);
+                    }
+                    enterState((State) observation.state);
+                    break;
+                    
+                case Observation::CAMERA_BOARD:
+                    calibrationCamera.addImagePoints(observation.cameraImagePoints, observation.imageSize);
+                    cameraImageSize = observation.imageSize;
+                    break;
+                    
+                case Observation::PROJECTOR_BOARD:
+                    calibrationCamera.imagePoints.push_back(observation.cameraImagePoints);
+                    calibrationCamera.getObjectPoints().push_back(observation.cameraObjectPoints);
+                    calibrationCamera.getBoardRotations().push_back(observation.boardRot);
+                    calibrationCamera.getBoardTranslations().push_back(observation.boardTrans);
+                    calibrationProjector.imagePoints.push_back(observation.projectorImagePoints);
+                    calibrationProjector.getObjectPoints().push_back(observation.projectorObjectPoints);
+                    
+                    // bounded sessions are replayed board by board like they were captured,
+                    // so memory stays within the window however long the log
+                    if(settings.maxBoardsInMemory > 0 && calibrationProjector.size() > settings.maxBoardsInMemory) {
+                        if(boundedAdjuster.getNumBoards() == 0) {
+                            calibrationProjector.calibrateWithUncertainty();
+                            stereoCalibrate();
+                        }
+                        float rms;
+                        addBounded(rms);
+                    }
+                    break;
+                    
+                default:
+                    break;
+            }
+        }
+        
+        // solves once with every replayed board instead of after each one
+        if(state == CAMERA && calibrationCamera.size() > 0) {
+            cameraBoardSelector.setup(cameraImageSize);
+            calibrationCamera.calibrateWithUncertainty();
+            if(calibrationCamera.size() >= settings.numBoardsBeforeCleaning) {
+                calibrationCamera.cleanWithUncertainty(settings.maxReprojErrorCamera);
+            }
+            cameraBoardSelector.update(calibrationCamera);
+        }
+        else if(state != CAMERA && calibrationProjector.size() > 0 && !isBounded()) {
+            calibrationProjector.calibrateWithUncertainty();
+            if(calibrationProjector.size() >= settings.numBoardsBeforeCleaning) {
+                cleanStereo(settings.maxReprojErrorProjector);
+            }
+            projectorBoardSelector.update(calibrationProjector);
+            stereoCalibrate();
+        }
+        else if(isBounded()) {
+            projectorBoardSelector.update(calibrationProjector);
+        }
+        
+        // the saved results of a finished session came from the joint refinement
+        if(state == FINISHED && calibrationProjector.size() > 0) {
+            bundleAdjust();
+        }
+    }
+    
+    void CameraProjectorCalibration::update(cv::Mat camMat){
+        update(camMat, ofGetElapsedTimef());
+    }
+    
+    void CameraProjectorCalibration::update(cv::Mat camMat, double timestamp){
+        
+        switch (state) {
+                
+            case CAMERA:
+                if( !updateCamDiff(camMat, timestamp) ) return;
+                
+                if( calibrateCamera(camMat) ){
+                    lastCaptureTime = timestamp;
+                }
+                break;
+                
+            case PROJECTOR_STATIC:
+                if( !updateCamDiff(camMat, timestamp) ) return;
+                
+                if( calibrateProjector(camMat) ){
+                    lastCaptureTime = timestamp;
+                }
+                break;
+                
+            case PROJECTOR_DYNAMIC:
+                if(captureScheduler.isIdle()){
+                    if( setDynamicProjectorImagePoints(camMat) ){
+                        if( !updateCamDiff(camMat, timestamp) ) return;
+                        
+                        captureScheduler.patternChanged();
+                    }
+                }
+                else if(captureScheduler.isFrameCurrent(timestamp)) {
+                    if( calibrateProjector(camMat) ) {
+                        lastCaptureTime = timestamp;
+                    }
+                    captureScheduler.consume();
+                }
+                break;
+                
+            default: break;
+        }
+    }
+    
+    bool CameraProjectorCalibration::updateCamDiff(const cv::Mat & camMat, double timestamp){
+        
+        if(previousFrame.size() != camMat.size() || previousFrame.type() != camMat.type()) {
+            camMat.copyTo(previousFrame);
+            return false;
+        }
+        
+        cv::absdiff(previousFrame, camMat, diffFrame);
+        diffMean = cv::mean(cv::Mat(cv::mean(diffFrame)))[0];
+        camMat.copyTo(previousFrame);
+        
+        float timeDiff = timestamp - lastCaptureTime;
+        
+        return settings.timeMinBetweenCaptures < timeDiff && settings.diffMinBetweenFrames > diffMean;
+    }
+    
+    bool CameraProjectorCalibration::calibrateCamera(const cv::Mat & img){
+        
+        cameraBoardSelector.setTargetStdDev(settings.targetStdDevCamera, settings.targetStdDevCamera);
+        
+        vector<cv::Point2f> imgPts;
+        bool bFound = calibrationCamera.findBoard(img, imgPts);
+        if(bFound){
+            
+            if(calibrationCamera.size() == 0) {
+                cameraBoardSelector.setup(img.size());
+            }
+            
+            if(calibrationCamera.isReady()) {
+                cv::Mat boardRot, boardTrans;
+                calibrationCamera.computeCandidateBoardPose(imgPts, boardRot, boardTrans);
+                if(!cameraBoardSelector.isInformative(calibrationCamera.getCandidateObjectPoints(), boardRot, boardTrans)) {
+                    notify(Event::BOARD_REJECTED, "Board pose too close to the stored ones, skipping");
+                    return false;
+                }
+            }
+            
+            calibrationCamera.addImagePoints(imgPts, img.size());
+            
+            Observation observation;
+            observation.type = Observation::CAMERA_BOARD;
+            observation.imageSize = img.size();
+            observation.cameraImagePoints = imgPts;
+            observation.cameraObjectPoints = calibrationCamera.getCandidateObjectPoints();
+            observationLog.append(observation);
+            
+            calibrationCamera.calibrateWithUncertainty();
+            
+            if(calibrationCamera.size() >= settings.numBoardsBeforeCleaning) {
+                
+                calibrationCamera.cleanWithUncertainty(settings.maxReprojErrorCamera);
+                notify(Event::BOARDS_CLEANED, "Cleaning");
+                
+                if(calibrationCamera.getReprojectionError(calibrationCamera.size()-1) > settings.maxReprojErrorCamera) {
+                    notify(Event::BOARD_REJECTED, "Board found, but reproj. error is too high, skipping");
+                    return false;
+                }
+            }
+            
+            cameraBoardSelector.update(calibrationCamera);
+            notify(Event::BOARD_ACCEPTED, "Found board!", calibrationCamera.getReprojectionError());
+            
+            if (cameraBoardSelector.isTargetReached() || calibrationCamera.size() >= settings.numBoardsFinalCamera) {
+                
+                if(settings.bSaveResults) {
+                    calibrationCamera.save(settings.cameraConfig);
+                    notify(Event::SAVED, "Camera calibration finished & saved to " + settings.cameraConfig);
+                }
+                setState(PROJECTOR_STATIC);
+            }
+        } else notify(Event::MESSAGE, "Could not find board");
+        
+        return bFound;
+    }
+    
+    bool CameraProjectorCalibration::calibrateProjector(const cv::Mat & img){
+        
+        projectorBoardSelector.setTargetStdDev(settings.targetStdDevProjector, settings.targetStdDevProjector);
+        
+        processImageForCircleDetection(img, processedImg, settings.circleDetectionThreshold);
+        
+        if(addProjected(img, processedImg)){
+            
+            notify(Event::BOARD_ACCEPTED, "Calibrating projector");
+            
+            if(isBounded() || (settings.maxBoardsInMemory > 0 && calibrationProjector.size() > settings.maxBoardsInMemory)) {
+                
+                float rms;
+                if(!addBounded(rms)) {
+                    notify(Event::BOARD_REJECTED, "Board found, but reproj. error is too high, skipping");
+                    return false;
+                }
+                
+                projectorBoardSelector.update(calibrationProjector);
+                
+                notify(Event::SOLVED, "Bounded refinement done, " + ofToString(boundedAdjuster.getNumMarginalizedBoards()) + " boards marginalized", rms);
+                
+            } else {
+                
+                calibrationProjector.calibrateWithUncertainty();
+                
+                if(calibrationProjector.size() >= settings.numBoardsBeforeCleaning) {
+                    
+                    int numBoardRemoved = cleanStereo(settings.maxReprojErrorProjector);
+                    
+                    notify(Event::BOARDS_CLEANED, ofToString(numBoardRemoved) + " boards removed");
+                    
+                    if(state == PROJECTOR_DYNAMIC && calibrationProjector.size() < settings.numBoardsBeforeDynamicProjection) {
+                        notify(Event::MESSAGE, "Too many boards removed, restarting to PROJECTOR_STATIC");
+                        setState(PROJECTOR_STATIC);
+                        return false;
+                    }
+                }
+                
+                projectorBoardSelector.update(calibrationProjector);
+                
+                stereoCalibrate();
+                
+                notify(Event::SOLVED, "Stereo-calibration done", calibrationProjector.getReprojectionError());
+                
+            }
+            
+            // the marginalized boards still count
+            int numBoards = calibrationProjector.size() + boundedAdjuster.getNumMarginalizedBoards();
+            
+            if(state == PROJECTOR_STATIC) {
+                
+                if( numBoards < settings.numBoardsBeforeDynamicProjection) {
+                    notify(Event::MESSAGE, ofToString(settings.numBoardsBeforeDynamicProjection - numBoards) + " boards to go before dynamic projection");
+                } else {
+                    setState(PROJECTOR_DYNAMIC);
+                }
+                
+            } else {
+                
+                if( numBoards < settings.numBoardsFinalProjector && !projectorBoardSelector.isTargetReached()) {
+                    notify(Event::MESSAGE, ofToString(settings.numBoardsFinalProjector - numBoards) + " boards to go to completion");
+                } else {
+                    float rms = bundleAdjust();
+                    notify(Event::SOLVED, "Joint refinement done, RMS error : " + ofToString(rms), rms);
+                    
+                    if(settings.bSaveResults) {
+                        calibrationCamera.save(settings.cameraConfig);
+                        calibrationProjector.save(settings.projectorConfig);
+                        saveExtrinsics(settings.extrinsicsConfig);
+                        notify(Event::SAVED, "Calibration finished & saved to " + settings.projectorConfig + " and " + settings.extrinsicsConfig);
+                    }
+                    setState(FINISHED);
+                }
+            }
+            return true;
+        }
+        return false;
+    }
+    
+    void CameraProjectorCalibration::setCamToProjExtrinsics(const cv::Mat & rot, const cv::Mat & trans){
+        rot.convertTo(rotCamToProj, CV_64F);
+        trans.convertTo(transCamToProj, CV_64F);
+    }
+    
     void CameraProjectorCalibration::saveExtrinsics(string filename, bool absolute) const {
         
         cv::FileStorage fs(ofToDataPath(filename, absolute), cv::FileStorage::WRITE);
@@ -151,54 +587,121 @@ namespace ofxCv {
     vector<Point2f> CameraProjectorCalibration::getProjected(const vector<Point3f> & pts,
                                                              const cv::Mat & rotObjToCam,
                                                              const cv::Mat & transObjToCam){
-        cv::Mat rotObjToProj, transObjToProj;
-        
-        cv::composeRT(rotObjToCam,  transObjToCam,
-                      rotCamToProj, transCamToProj,
-                      rotObjToProj, transObjToProj);
+        RigidPose<double> objToProj = RigidPose<double>(rotObjToCam, transObjToCam)
+            .then(RigidPose<double>(rotCamToProj, transCamToProj));
+        LensModel<double> lens(calibrationProjector.getDistortedIntrinsics().getCameraMatrix(),
+                               calibrationProjector.getDistCoeffs());
         
         vector<Point2f> out;
-        projectPoints(Mat(pts),
-                      rotObjToProj, transObjToProj,
-                      calibrationProjector.getDistortedIntrinsics().getCameraMatrix(),
-                      calibrationProjector.getDistCoeffs(),
-                      out);
+        projectToImage(lens, objToProj, pts, out);
         return out;
     }
     
+    vector<Point2f> CameraProjectorCalibration::getProjected(const vector<Point3f> & pts,
+                                                             const PosePredictor & predictor){
+        cv::Mat rotObjToCam, transObjToCam;
+        if(!predictor.predict(rotObjToCam, transObjToCam)) {
+            return vector<Point2f>();
+        }
+        return getProjected(pts, rotObjToCam, transObjToCam);
+    }
+    
+    KernelAccuracy CameraProjectorCalibration::checkKernelAccuracy(int gridStep) const {
+        
+        // on the latest board, or a fronto-parallel plane a few baselines away
+        cv::Mat boardRot = cv::Mat::zeros(3, 1, CV_64F);
+        cv::Mat boardTrans = (cv::Mat_<double>(3, 1) << 0, 0, 10 * MAX(cv::norm(transCamToProj), 1.));
+        if(!calibrationCamera.getBoardRotations().empty()) {
+            boardRot = calibrationCamera.getBoardRotations().back();
+            boardTrans = calibrationCamera.getBoardTranslations().back();
+        }
+        
+        KernelAccuracy accuracy;
+        accuracy.check(calibrationCamera.getDistortedIntrinsics().getCameraMatrix(),
+                       calibrationCamera.getDistCoeffs(),
+                       calibrationCamera.getDistortedIntrinsics().getImageSize(),
+                       calibrationProjector.getDistortedIntrinsics().getCameraMatrix(),
+                       calibrationProjector.getDistCoeffs(),
+                       rotCamToProj, transCamToProj, boardRot, boardTrans, gridStep);
+        return accuracy;
+    }
+    
     bool CameraProjectorCalibration::addProjected(cv::Mat img, cv::Mat processedImg){
         
-        vector<cv::Point2f> chessImgPts;
+        vector<cv::Point2f> chessImgPts, circlesImgPts;
         
-        bool bPrintedPatternFound = calibrationCamera.findBoard(img, chessImgPts, true);
+        if(detectProjected(img, processedImg, chessImgPts, circlesImgPts)) {
+            return addProjected(chessImgPts, circlesImgPts);
+        }
+        return false;
+    }
+    
+    bool CameraProjectorCalibration::detectProjected(const cv::Mat & img, const cv::Mat & processedImg,
+                                                     vector<cv::Point2f> & chessImgPts,
+                                                     vector<cv::Point2f> & circlesImgPts) const {
+        
+        bool bPrintedPatternFound = calibrationCamera.detectBoard(img, chessImgPts);
         
         if(bPrintedPatternFound) {
-            
-            vector<cv::Point2f> circlesImgPts;
-            bool bProjectedPatternFound = cv::findCirclesGrid(processedImg, calibrationProjector.getPatternSize(), circlesImgPts, cv::CALIB_CB_ASYMMETRIC_GRID);
-            
-            if(bProjectedPatternFound){
-            
-                vector<cv::Point3f> circlesObjectPts;
-                cv::Mat boardRot;
-                cv::Mat boardTrans;
-                calibrationCamera.computeCandidateBoardPose(chessImgPts, boardRot, boardTrans);
-                calibrationCamera.backProject(boardRot, boardTrans, circlesImgPts, circlesObjectPts);
-                
-                calibrationCamera.imagePoints.push_back(chessImgPts);
-                calibrationCamera.getObjectPoints().push_back(calibrationCamera.getCandidateObjectPoints());
-                calibrationCamera.getBoardRotations().push_back(boardRot);
-                calibrationCamera.getBoardTranslations().push_back(boardTrans);
-                
-                calibrationProjector.imagePoints.push_back(calibrationProjector.getCandidateImagePoints());
-                calibrationProjector.getObjectPoints().push_back(circlesObjectPts);
-                
-                return true;
-            }
+            return cv::findCirclesGrid(processedImg, calibrationProjector.getPatternSize(), circlesImgPts, cv::CALIB_CB_ASYMMETRIC_GRID);
         }
         return false;
     }
     
+    bool CameraProjectorCalibration::addProjected(const vector<cv::Point2f> & chessImgPts,
+                                                  const vector<cv::Point2f> & circlesImgPts){
+        
+        vector<cv::Point3f> circlesObjectPts;
+        cv::Mat boardRot;
+        cv::Mat boardTrans;
+        calibrationCamera.computeCandidateBoardPose(chessImgPts, boardRot, boardTrans);
+        calibrationCamera.backProject(boardRot, boardTrans, circlesImgPts, circlesObjectPts);
+        
+        if(bBoardSelection && calibrationProjector.isReady()) {
+            cv::Mat projRot, projTrans;
+            cv::solvePnP(circlesObjectPts, calibrationProjector.getCandidateImagePoints(),
+                         calibrationProjector.getDistortedIntrinsics().getCameraMatrix(),
+                         calibrationProjector.getDistCoeffs(),
+                         projRot, projTrans);
+            if(!projectorBoardSelector.isInformative(circlesObjectPts, projRot, projTrans)) {
+                ofLogVerbose("CameraProjectorCalibration") << "redundant board pose, skipping";
+                return false;
+            }
+        }
+        
+        calibrationCamera.imagePoints.push_back(chessImgPts);
+        calibrationCamera.getObjectPoints().push_back(calibrationCamera.getCandidateObjectPoints());
+        calibrationCamera.getBoardRotations().push_back(boardRot);
+        calibrationCamera.getBoardTranslations().push_back(boardTrans);
+        
+        calibrationProjector.imagePoints.push_back(calibrationProjector.getCandidateImagePoints());
+        calibrationProjector.getObjectPoints().push_back(circlesObjectPts);
+        
+        if(observationLog.isOpen()) {
+            Observation observation;
+            observation.type = Observation::PROJECTOR_BOARD;
+            observation.cameraImagePoints = chessImgPts;
+            observation.cameraObjectPoints = calibrationCamera.getCandidateObjectPoints();
+            observation.boardRot = boardRot;
+            observation.boardTrans = boardTrans;
+            observation.projectorImagePoints = calibrationProjector.getCandidateImagePoints();
+            observation.projectorObjectPoints = circlesObjectPts;
+            observationLog.append(observation);
+        }
+        
+        return true;
+    }
+    
+    void CameraProjectorCalibration::processImageForCircleDetection(const cv::Mat & img, cv::Mat & processedImg, int threshold){
+        
+        if(img.type() != CV_8UC1) {
+            cvtColor(img, processedImg, CV_RGB2GRAY);
+        } else {
+            processedImg = img;
+        }
+        cv::threshold(processedImg, processedImg, threshold, 255, cv::THRESH_BINARY_INV);
+    }
+    
     bool CameraProjectorCalibration::setDynamicProjectorImagePoints(cv::Mat img){
         
         vector<cv::Point2f> chessImgPts;
@@ -286,11 +789,168 @@ namespace ofxCv {
                             essentialMatrix, fundamentalMatrix);
         
         cv::Rodrigues(rotation3x3, rotCamToProj);
+        
+        updateExtrinsicsUncertainty();
+    }
+    
+    void CameraProjectorCalibration::updateExtrinsicsUncertainty(){
+        
+        const auto & objectPoints = calibrationProjector.getObjectPoints();
+        
+        extrinsicsUncertainty.setup(rotCamToProj, transCamToProj,
+                                    calibrationProjector.getDistortedIntrinsics().getCameraMatrix(),
+                                    calibrationProjector.getDistCoeffs());
+        for (int i=0; i<objectPoints.size() ; i++ ) {
+            cv::Mat boardRot3x3, boardRT;
+            cv::Rodrigues(calibrationCamera.getBoardRotations()[i], boardRot3x3);
+            cv::hconcat(boardRot3x3, calibrationCamera.getBoardTranslations()[i], boardRT);
+            vector<cv::Point3f> ptsInCam;
+            cv::transform(objectPoints[i], ptsInCam, boardRT);
+            extrinsicsUncertainty.add(ptsInCam, calibrationProjector.imagePoints[i]);
+        }
     }
 
+    double CameraProjectorCalibration::bundleAdjust(int maxIterations){
+        
+        // the prior of the marginalized boards is only held by the bounded adjuster
+        if(isBounded()) {
+            boundedAdjuster.setMaxIterations(maxIterations);
+            double rms = boundedAdjuster.solve();
+            applyAdjusted(boundedAdjuster);
+            return rms;
+        }
+        
+        int numBoards = MIN(calibrationProjector.size(), calibrationCamera.getBoardRotations().size());
+        if(numBoards == 0 || rotCamToProj.empty()) return 0;
+        
+        BundleAdjuster adjuster;
+        adjuster.setMaxIterations(maxIterations);
+        setupAdjuster(adjuster);
+        for(int i = 0; i < numBoards; i++) {
+            addToAdjuster(adjuster, i);
+        }
+        
+        double rms = adjuster.solve();
+        applyAdjusted(adjuster);
+        return rms;
+    }
+    
+    void CameraProjectorCalibration::setupAdjuster(BundleAdjuster & adjuster) const {
+        adjuster.setIntrinsics(BundleAdjuster::CAMERA,
+                               calibrationCamera.getDistortedIntrinsics().getCameraMatrix(),
+                               calibrationCamera.getDistCoeffs());
+        adjuster.setIntrinsics(BundleAdjuster::PROJECTOR,
+                               calibrationProjector.getDistortedIntrinsics().getCameraMatrix(),
+                               calibrationProjector.getDistCoeffs());
+        adjuster.setExtrinsics(rotCamToProj, transCamToProj);
+    }
+    
+    void CameraProjectorCalibration::addToAdjuster(BundleAdjuster & adjuster, int i){
+        int board = adjuster.addBoard(calibrationCamera.getBoardRotations()[i], calibrationCamera.getBoardTranslations()[i]);
+        adjuster.addObservations(board, BundleAdjuster::CAMERA,
+                                 calibrationCamera.getObjectPoints()[i], calibrationCamera.imagePoints[i]);
+        adjuster.addObservations(board, BundleAdjuster::PROJECTOR,
+                                 calibrationProjector.getObjectPoints()[i], calibrationProjector.imagePoints[i]);
+    }
+    
+    void CameraProjectorCalibration::applyAdjusted(const BundleAdjuster & adjuster){
+        
+        rotCamToProj = adjuster.getCamToProjRotation().clone();
+        transCamToProj = adjuster.getCamToProjTranslation().clone();
+        
+        int numBoards = adjuster.getNumBoards();
+        auto & camRotations = calibrationCamera.getBoardRotations();
+        auto & camTranslations = calibrationCamera.getBoardTranslations();
+        auto & projRotations = calibrationProjector.getBoardRotations();
+        auto & projTranslations = calibrationProjector.getBoardTranslations();
+        projRotations.resize(numBoards);
+        projTranslations.resize(numBoards);
+        for(int i = 0; i < numBoards; i++) {
+            camRotations[i] = adjuster.getBoardRotation(i).clone();
+            camTranslations[i] = adjuster.getBoardTranslation(i).clone();
+            cv::composeRT(camRotations[i], camTranslations[i], rotCamToProj, transCamToProj,
+                          projRotations[i], projTranslations[i]);
+        }
+        
+        calibrationCamera.updateIntrinsics(adjuster.getCameraMatrix(BundleAdjuster::CAMERA),
+                                           adjuster.getDistCoeffs(BundleAdjuster::CAMERA));
+        calibrationProjector.updateIntrinsics(adjuster.getCameraMatrix(BundleAdjuster::PROJECTOR),
+                                              adjuster.getDistCoeffs(BundleAdjuster::PROJECTOR));
+        updateExtrinsicsUncertainty();
+    }
+    
+    float CameraProjectorCalibration::updateBounded(){
+        
+        int newest = calibrationProjector.size() - 1;
+        if(boundedAdjuster.getNumBoards() == 0) {
+            // the window starts from a joint solution of the boards stored so far
+            boundedAdjuster.setMaxBoards(0);
+            boundedAdjuster.setMaxPointsPerObservation(settings.maxPointsPerBoard);
+            setupAdjuster(boundedAdjuster);
+            for(int i = 0; i < newest; i++) {
+                addToAdjuster(boundedAdjuster, i);
+            }
+            boundedAdjuster.solve();
+            boundedAdjuster.setMaxBoards(settings.maxBoardsInMemory);
+        }
+        addToAdjuster(boundedAdjuster, newest);
+        
+        // the marginalized boards are the oldest ones
+        while(calibrationProjector.size() > boundedAdjuster.getNumBoards()) {
+            calibrationCamera.remove(0);
+            calibrationProjector.remove(0);
+        }
+        
+        boundedAdjuster.setMaxIterations(10);
+        float rms = boundedAdjuster.solve();
+        applyAdjusted(boundedAdjuster);
+        return rms;
+    }
+    
+    bool CameraProjectorCalibration::addBounded(float & rms){
+        int newest = calibrationProjector.size() - 1;
+        if(!rotCamToProj.empty() && getStereoReprojectionError(newest) > settings.maxReprojErrorProjector) {
+            removeNewestBoard();
+            return false;
+        }
+        rms = updateBounded();
+        return true;
+    }
+    
+    float CameraProjectorCalibration::getStereoReprojectionError(int board){
+        RigidPose<double> boardToCam(calibrationCamera.getBoardRotations()[board], calibrationCamera.getBoardTranslations()[board]);
+        RigidPose<double> boardToProj = boardToCam.then(RigidPose<double>(rotCamToProj, transCamToProj));
+        LensModel<double> projectorLens(calibrationProjector.getDistortedIntrinsics().getCameraMatrix(),
+                                        calibrationProjector.getDistCoeffs());
+        
+        const vector<cv::Point2f> & imagePoints = calibrationProjector.imagePoints[board];
+        vector<cv::Point2f> projected;
+        projectToImage(projectorLens, boardToProj, calibrationProjector.getObjectPoints()[board], projected);
+        if(projected.empty()) return 0;
+        double squaredError = 0;
+        for(size_t i = 0; i < projected.size(); i++) {
+            cv::Point2f diff = projected[i] - imagePoints[i];
+            squaredError += diff.dot(diff);
+        }
+        return sqrt(squaredError / projected.size());
+    }
+    
+    void CameraProjectorCalibration::removeNewestBoard(){
+        int newest = calibrationProjector.size() - 1;
+        calibrationCamera.remove(newest);
+        // the projector poses of a new board aren't solved yet
+        if((int) calibrationProjector.getBoardRotations().size() > newest) {
+            calibrationProjector.remove(newest);
+        } else {
+            calibrationProjector.imagePoints.pop_back();
+            calibrationProjector.getObjectPoints().pop_back();
+        }
+    }
+    
     void CameraProjectorCalibration::resetBoards(){
         calibrationCamera.resetBoards();
         calibrationProjector.resetBoards();
+        boundedAdjuster.clear();
     }
     
     int CameraProjectorCalibration::cleanStereo(float maxReproj){
@@ -13,28 +13,71 @@
 
 #include "ofMain.h"
 #include "ofxCv.h"
+#include "ofxCvPosePredictor.h"
+#include "ofxCvProjectorLatency.h"
+#include "ofxCvBoardSelector.h"
+#include "ofxCvCalibrationUncertainty.h"
+#include "ofxCvBundleAdjuster.h"
+#include "ofxCvObservationLog.h"
+#include "ofxCvUndistortionMap.h"
+#include "ofxCvPatternRasterizer.h"
+#include "ofxCvEventLog.h"
+#include "ofxCvProjectionKernels.h"
 
 namespace ofxCv {
     
     class CalibrationPatched : public Calibration {
         
     public:
+        // solves, then updates the parameters uncertainty from the Jacobians at the solution.
+        // Calibration::calibrate & clean aren't virtual, they leave the uncertainty stale
+        bool calibrateWithUncertainty() {
+            bool bReady = Calibration::calibrate();
+            updateUncertainty();
+            return bReady;
+        }
+        bool cleanWithUncertainty(float minReprojectionError = 2.f) {
+            bool bReady = Calibration::clean(minReprojectionError);
+            updateUncertainty();
+            return bReady;
+        }
+        // keeps the blocks of the boards left untouched while the intrinsics are the same
+        // (e.g. a board added or removed without a solve), rebuilds every board otherwise
+        void updateUncertainty();
+        // same detection as findBoard without touching any member, safe to call from worker threads
+        bool detectBoard(const cv::Mat & img, vector<cv::Point2f> & pointBuf) const;
+        // replaces the intrinsics (e.g. after a joint refinement) and refreshes the derived values
+        void updateIntrinsics(const cv::Mat & cameraMatrix, const cv::Mat & distCoeffs);
+        const IntrinsicsUncertainty & getUncertainty() const { return uncertainty; }
+        
         void resetBoards() {
             objectPoints.clear();
             imagePoints.clear();
             boardRotations.clear();
             boardTranslations.clear();
+            uncertainty = IntrinsicsUncertainty();
+        }
+        void addImagePoints(const vector<cv::Point2f> & pts, cv::Size imageSize) {
+            imagePoints.push_back(pts);
+            addedImageSize = imageSize;
         }
         void remove(int index){
             objectPoints.erase(objectPoints.begin() + index);
             imagePoints.erase(imagePoints.begin() + index);
             boardRotations.erase(boardRotations.begin() + index);
             boardTranslations.erase(boardTranslations.begin() + index);
+            if(index < uncertainty.size()) uncertainty.remove(index);
         }
-        cv::Size getPatternSize() { return patternSize; }
+        cv::Size getPatternSize() const { return patternSize; }
         vector<cv::Mat> & getBoardRotations() { return boardRotations; }
         vector<cv::Mat> & getBoardTranslations() { return boardTranslations; }
+        const vector<cv::Mat> & getBoardRotations() const { return boardRotations; }
+        const vector<cv::Mat> & getBoardTranslations() const { return boardTranslations; }
         vector<vector<cv::Point3f> > & getObjectPoints() { return objectPoints; }
+        const vector<vector<cv::Point3f> > & getObjectPoints() const { return objectPoints; }
+        
+    protected:
+        IntrinsicsUncertainty uncertainty;
     };
     
 #pragma mark - CameraCalibration
@@ -48,9 +91,12 @@ namespace ofxCv {
                          vector<cv::Point3f>& worldPt);
         void setupCandidateObjectPoints();
         vector<cv::Point3f> getCandidateObjectPoints() { return candidateObjectPts; }
+        // rebuilt when the intrinsics change
+        const UndistortionMap & getUndistortionMap();
         
     private:
         vector<cv::Point3f> candidateObjectPts;
+        UndistortionMap undistortionMap;
     };
     
 #pragma mark - ProjectorCalibration
@@ -78,38 +124,178 @@ namespace ofxCv {
         
     public:
         
+        enum State {
+            CAMERA,
+            PROJECTOR_STATIC,
+            PROJECTOR_DYNAMIC,
+            FINISHED
+        };
+        
+        // parameters of the streaming calibration run by update()
+        struct Settings {
+            Settings();
+            float diffMinBetweenFrames;
+            float timeMinBetweenCaptures;
+            int numBoardsFinalCamera;
+            int numBoardsFinalProjector;
+            int numBoardsBeforeCleaning;
+            int numBoardsBeforeDynamicProjection;
+            float maxReprojErrorCamera;
+            float maxReprojErrorProjector;
+            float targetStdDevCamera;
+            float targetStdDevProjector;
+            int circleDetectionThreshold;
+            // bounded memory : past this many projector boards the oldest ones are folded
+            // into the bundle adjustment prior and dropped, 0 keeps every board
+            int maxBoardsInMemory;
+            // dense observations are subsampled to this many points, 0 keeps every point
+            int maxPointsPerBoard;
+            // also reloads cameraConfig when entering PROJECTOR_STATIC
+            bool bSaveResults;
+            string cameraConfig, projectorConfig, extrinsicsConfig;
+        };
+        
+        struct Event {
+            enum Type {
+                STATE_CHANGED,
+                BOARD_ACCEPTED,
+                BOARD_REJECTED,
+                BOARDS_CLEANED,
+                SOLVED,
+                SAVED,
+                MESSAGE
+            };
+            Type type;
+            State state;
+            int numBoards;
+            float reprojError;
+            string message;
+        };
+        
+        CameraProjectorCalibration();
+        
         void load(string cameraConfig = "calibrationCamera.yml",
                   string projectorConfig  = "calibrationProjector.yml",
                   string extrinsicsConfig = "CameraProjectorExtrinsics.yml");
         void setup(int projectorWidth, int projectorHeight);
+        
+        // streaming calibration : feed every new camera frame, the frame data is never copied
+        // except into the motion detection buffer
         void update(cv::Mat camMat);
+        void update(cv::Mat camMat, double timestamp);
+        
+        void setState(State state);
+        State getState() const { return state; }
+        static string getStateName(State state);
+        Settings & getSettings() { return settings; }
+        CaptureScheduler & getCaptureScheduler() { return captureScheduler; }
+        float getFrameDifference() const { return diffMean; }
+        const cv::Mat & getProcessedImage() const { return processedImg; }
+        
+        ofEvent<Event> calibrationEvent;
+        
+        // every event is also recorded in a bounded log, which can be read from any thread
+        const EventLog & getEventLog() const { return eventLog; }
+        void logMessage(const string & message) { notify(Event::MESSAGE, message); }
+        bool exportEventLog(const string & path, bool absolute = false) const;
+        static string getEventTypeName(Event::Type type);
+        
+        // writes every accepted board to an append-only log. When resuming, the boards
+        // already in the log are replayed first, returns true if a session was restored
+        bool openSession(const string & path, bool bResume = true);
+        void closeSession() { observationLog.close(); }
         
         void saveExtrinsics(string filename, bool absolute = false) const;
         void loadExtrinsics(string filename, bool absolute = false);
         
         bool addProjected(cv::Mat img, cv::Mat processedImg);
+        // detection half of addProjected, thread-safe so frames can be processed in parallel
+        bool detectProjected(const cv::Mat & img, const cv::Mat & processedImg,
+                             vector<cv::Point2f> & chessImgPts,
+                             vector<cv::Point2f> & circlesImgPts) const;
+        // stores a detection made by detectProjected
+        bool addProjected(const vector<cv::Point2f> & chessImgPts,
+                          const vector<cv::Point2f> & circlesImgPts);
+        // reads no member, safe from any thread
+        static void processImageForCircleDetection(const cv::Mat & img, cv::Mat & processedImg, int threshold);
         
         bool setDynamicProjectorImagePoints(cv::Mat img);
         void stereoCalibrate();
+        // joint refinement of both intrinsics, the extrinsics and all board poses, returns the RMS error
+        double bundleAdjust(int maxIterations = 30);
         void resetBoards();
         int cleanStereo(float maxReproj);
         
         vector<Point2f> getProjected(const vector<Point3f> & ptsInWorld,
                                      const cv::Mat & rotObjToCam = Mat::zeros(3, 1, CV_64F),
                                      const cv::Mat & transObjToCam = Mat::zeros(3, 1, CV_64F));
+        // projects using the object pose extrapolated to the projector display time
+        vector<Point2f> getProjected(const vector<Point3f> & ptsInWorld,
+                                     const PosePredictor & predictor);
+        // float kernels against the double reference on the current calibration
+        KernelAccuracy checkKernelAccuracy(int gridStep = 16) const;
         
         CameraCalibration & getCalibrationCamera() { return calibrationCamera; }
         ProjectorCalibration & getCalibrationProjector() { return calibrationProjector; }
+        const CameraCalibration & getCalibrationCamera() const { return calibrationCamera; }
+        const ProjectorCalibration & getCalibrationProjector() const { return calibrationProjector; }
+        
+        // when enabled, addProjected rejects boards that don't reduce the projector uncertainty
+        void setBoardSelection(bool enabled) { bBoardSelection = enabled; }
+        BoardSelector & getCameraBoardSelector() { return cameraBoardSelector; }
+        BoardSelector & getProjectorBoardSelector() { return projectorBoardSelector; }
         
-        const cv::Mat & getCamToProjRotation() { return rotCamToProj; }
-        const cv::Mat & getCamToProjTranslation() { return transCamToProj; }
+        const cv::Mat & getCamToProjRotation() const { return rotCamToProj; }
+        const cv::Mat & getCamToProjTranslation() const { return transCamToProj; }
+        void setCamToProjExtrinsics(const cv::Mat & rot, const cv::Mat & trans);
+        // std dev of [rot trans] from the last stereoCalibrate
+        const ExtrinsicsUncertainty & getExtrinsicsUncertainty() const { return extrinsicsUncertainty; }
         
     protected:
         
+        void updateExtrinsicsUncertainty();
+        void setupAdjuster(BundleAdjuster & adjuster) const;
+        void addToAdjuster(BundleAdjuster & adjuster, int board);
+        void applyAdjusted(const BundleAdjuster & adjuster);
+        // adds the newest board to the bounded adjuster and drops the marginalized ones
+        float updateBounded();
+        // rejects the newest board if it doesn't agree with the current parameters,
+        // before it can skew them, then adds it to the bounded adjuster
+        bool addBounded(float & rms);
+        // projector RMS error of a board with its camera pose and the current extrinsics
+        float getStereoReprojectionError(int board);
+        void removeNewestBoard();
+        bool isBounded() const { return boundedAdjuster.getNumMarginalizedBoards() > 0; }
+        
+        bool updateCamDiff(const cv::Mat & camMat, double timestamp);
+        bool calibrateCamera(const cv::Mat & camMat);
+        bool calibrateProjector(const cv::Mat & camMat);
+        void notify(Event::Type type, const string & message, float reprojError = 0);
+        void enterState(State state);
+        void replay(const vector<Observation> & observations);
+        
+        State state;
+        Settings settings;
+        CaptureScheduler captureScheduler;
+        
+        // buffers reused from frame to frame
+        cv::Mat previousFrame, diffFrame, processedImg;
+        float diffMean;
+        double lastCaptureTime;
+        
+        ObservationLog observationLog;
+        EventLog eventLog;
+        
         CameraCalibration calibrationCamera;
         ProjectorCalibration calibrationProjector;
         
         cv::Mat rotCamToProj;
         cv::Mat transCamToProj;
+        ExtrinsicsUncertainty extrinsicsUncertainty;
+        BundleAdjuster boundedAdjuster;
+        
+        bool bBoardSelection;
+        BoardSelector cameraBoardSelector;
+        BoardSelector projectorBoardSelector;
     };
 }
\ No newline at end of file
@@ -0,0 +1,293 @@
+/*
+ * ofxCvDriftMonitor.cpp
+ *
+ * Checks in the background that the camera -> projector extrinsics still hold
+ * during live projection : a sparse circles pattern is occasionally projected on
+ * the printed board, its reprojection error is measured against the calibration,
+ * and the extrinsics are re-estimated when it drifts above a bound.
+ */
+
+#include "ofxCvDriftMonitor.h"
+
+namespace ofxCv {
+
+    DriftMonitor::DriftMonitor()
+    :bPatternRequested(false)
+    ,bCorrectionReady(false)
+    ,lastError(-1)
+    ,numChecks(0)
+    ,numCorrections(0)
+    ,dutyCycle(0.02)
+    ,checkInterval(5)
+    ,maxDrift(2)
+    ,numObservationsForCorrection(3)
+    ,bAutoCorrect(true)
+    ,circleDetectionThreshold(220) {
+    }
+
+    DriftMonitor::~DriftMonitor(){
+        stop();
+    }
+
+    void DriftMonitor::setup(CameraProjectorCalibration & calibration){
+        stop();
+
+        CameraCalibration & calibrationCamera = calibration.getCalibrationCamera();
+        ProjectorCalibration & calibrationProjector = calibration.getCalibrationProjector();
+
+        if(calibrationCamera.getCandidateObjectPoints().empty()) {
+            calibrationCamera.setupCandidateObjectPoints();
+        }
+        if(calibrationProjector.getCandidateImagePoints().empty()) {
+            calibrationProjector.setStaticCandidateImagePoints();
+        }
+        boardPoints = calibrationCamera.getCandidateObjectPoints();
+        patternPoints = calibrationProjector.getCandidateImagePoints();
+
+        snapshot = std::make_shared<CalibrationSnapshot>(calibration);
+        boardDetector = calibrationCamera;
+        boardDetector.resetBoards();
+        circlesPatternSize = calibrationProjector.getPatternSize();
+        rotCamToProj = snapshot->getCamToProjRotation().clone();
+        transCamToProj = snapshot->getCamToProjTranslation().clone();
+
+        bPatternRequested = false;
+        pendingFrame = cv::Mat();
+        bCorrectionReady = false;
+        lastError = -1;
+        numChecks = 0;
+        numCorrections = 0;
+        driftedObservations.clear();
+        captureScheduler.consume();
+    }
+
+    void DriftMonitor::start(){
+        if(!snapshot || rotCamToProj.empty()) {
+            ofLogError("DriftMonitor") << "setup with a stereo calibrated CameraProjectorCalibration first";
+            return;
+        }
+        if(!isThreadRunning()) {
+            startThread(true, false);
+        }
+    }
+
+    void DriftMonitor::stop(){
+        if(isThreadRunning()) {
+            waitForThread(true);
+        }
+    }
+
+    void DriftMonitor::setLatency(double seconds){
+        lock();
+        captureScheduler.setLatency(seconds);
+        unlock();
+    }
+
+#pragma mark - main thread
+
+    bool DriftMonitor::isPatternRequested(){
+        lock();
+        bool bRequested = bPatternRequested;
+        unlock();
+        return bRequested;
+    }
+
+    void DriftMonitor::patternDisplayed(double displayTime){
+        lock();
+        if(captureScheduler.isWaitingForDisplay()) {
+            captureScheduler.patternDisplayed(displayTime);
+        }
+        unlock();
+    }
+
+    void DriftMonitor::addFrame(const cv::Mat & camMat, double captureTime){
+        lock();
+        if(bPatternRequested && captureScheduler.isFrameCurrent(captureTime)) {
+            camMat.copyTo(pendingFrame);
+            bPatternRequested = false;
+            captureScheduler.consume();
+        }
+        unlock();
+    }
+
+    bool DriftMonitor::update(CameraProjectorCalibration & calibration){
+        lock();
+        if(!bCorrectionReady) {
+            unlock();
+            return false;
+        }
+        cv::Mat rot = correctedRot, trans = correctedTrans;
+        bCorrectionReady = false;
+        unlock();
+
+        calibration.setCamToProjExtrinsics(rot, trans);
+        return true;
+    }
+
+    float DriftMonitor::getLastError(){
+        lock();
+        float error = lastError;
+        unlock();
+        return error;
+    }
+
+    int DriftMonitor::getNumChecks(){
+        lock();
+        int num = numChecks;
+        unlock();
+        return num;
+    }
+
+    int DriftMonitor::getNumCorrections(){
+        lock();
+        int num = numCorrections;
+        unlock();
+        return num;
+    }
+
+#pragma mark - monitor thread
+
+    void DriftMonitor::threadedFunction(){
+
+        while(isThreadRunning()) {
+
+            cv::Mat frame;
+            lock();
+            if(!pendingFrame.empty()) {
+                frame = pendingFrame;
+                pendingFrame = cv::Mat();
+            } else if(!bPatternRequested) {
+                bPatternRequested = true;
+                captureScheduler.patternChanged();
+            }
+            unlock();
+
+            if(frame.empty()) {
+                idle(0.01);
+                continue;
+            }
+
+            unsigned long long startTime = ofGetElapsedTimeMicros();
+
+            vector<cv::Point3f> ptsInCam;
+            float error;
+            if(measure(frame, ptsInCam, error)) {
+                lock();
+                lastError = error;
+                numChecks++;
+                unlock();
+
+                if(error > maxDrift) {
+                    ofLogVerbose("DriftMonitor") << "extrinsics drifted, reprojection error " << error;
+                    driftedObservations.push_back(ptsInCam);
+                    if(bAutoCorrect && (int) driftedObservations.size() >= numObservationsForCorrection) {
+                        correct();
+                    }
+                } else {
+                    driftedObservations.clear();
+                }
+            }
+
+            // sleep long enough to stay within the cpu budget
+            double busyTime = (ofGetElapsedTimeMicros() - startTime) / 1000000.;
+            idle(MAX(checkInterval - busyTime, busyTime * (1 - dutyCycle) / dutyCycle));
+        }
+    }
+
+    void DriftMonitor::idle(double seconds){
+        unsigned long long endTime = ofGetElapsedTimeMicros() + seconds * 1000000;
+        while(isThreadRunning() && ofGetElapsedTimeMicros() < endTime) {
+            sleep(MIN(50, MAX(1, (long) ((endTime - ofGetElapsedTimeMicros()) / 1000))));
+        }
+    }
+
+    bool DriftMonitor::measure(const cv::Mat & img, vector<cv::Point3f> & ptsInCam, float & error){
+
+        vector<cv::Point2f> chessImgPts, circlesImgPts;
+        CameraProjectorCalibration::processImageForCircleDetection(img, processedImg, circleDetectionThreshold);
+        if(!boardDetector.detectBoard(img, chessImgPts) ||
+           !cv::findCirclesGrid(processedImg, circlesPatternSize, circlesImgPts, cv::CALIB_CB_ASYMMETRIC_GRID)) {
+            return false;
+        }
+
+        const cv::Mat & cameraMatrix = snapshot->getCameraIntrinsics().getCameraMatrix();
+        const cv::Mat & cameraDistCoeffs = snapshot->getCameraDistCoeffs();
+        const cv::Mat & projectorMatrix = snapshot->getProjectorIntrinsics().getCameraMatrix();
+        const cv::Mat & projectorDistCoeffs = snapshot->getProjectorDistCoeffs();
+
+        cv::Mat boardRot, boardTrans;
+        cv::solvePnP(boardPoints, chessImgPts, cameraMatrix, cameraDistCoeffs, boardRot, boardTrans);
+
+        // intersects the circles camera rays with the board plane
+        vector<cv::Point2f> normalizedPts;
+        cv::undistortPoints(circlesImgPts, normalizedPts, cameraMatrix, cameraDistCoeffs);
+        cv::Mat_<double> rot3x3;
+        cv::Rodrigues(boardRot, rot3x3);
+        cv::Vec3d normal(rot3x3(0, 2), rot3x3(1, 2), rot3x3(2, 2));
+        cv::Vec3d origin(boardTrans.at<double>(0), boardTrans.at<double>(1), boardTrans.at<double>(2));
+        double distance = normal.dot(origin);
+
+        ptsInCam.resize(normalizedPts.size());
+        for(size_t i = 0; i < normalizedPts.size(); i++) {
+            cv::Vec3d ray(normalizedPts[i].x, normalizedPts[i].y, 1);
+            ray *= distance / normal.dot(ray);
+            ptsInCam[i] = cv::Point3f(ray[0], ray[1], ray[2]);
+        }
+
+        vector<cv::Point2f> projectedPts;
+        cv::projectPoints(cv::Mat(ptsInCam), rotCamToProj, transCamToProj,
+                          projectorMatrix, projectorDistCoeffs, projectedPts);
+        double squaredError = 0;
+        for(size_t i = 0; i < projectedPts.size(); i++) {
+            cv::Point2f d = projectedPts[i] - patternPoints[i];
+            squaredError += d.dot(d);
+        }
+        error = sqrt(squaredError / projectedPts.size());
+        return true;
+    }
+
+    void DriftMonitor::correct(){
+
+        vector<cv::Point3f> objectPts;
+        vector<cv::Point2f> imagePts;
+        for(size_t i = 0; i < driftedObservations.size(); i++) {
+            objectPts.insert(objectPts.end(), driftedObservations[i].begin(), driftedObservations[i].end());
+            imagePts.insert(imagePts.end(), patternPoints.begin(), patternPoints.end());
+        }
+        driftedObservations.clear();
+
+        const cv::Mat & projectorMatrix = snapshot->getProjectorIntrinsics().getCameraMatrix();
+        const cv::Mat & projectorDistCoeffs = snapshot->getProjectorDistCoeffs();
+
+        // points are in the camera frame, so the projector pose is the extrinsics
+        cv::Mat rot = rotCamToProj.clone(), trans = transCamToProj.clone();
+        cv::solvePnP(objectPts, imagePts, projectorMatrix, projectorDistCoeffs, rot, trans, true);
+
+        vector<cv::Point2f> projectedPts;
+        cv::projectPoints(cv::Mat(objectPts), rot, trans, projectorMatrix, projectorDistCoeffs, projectedPts);
+        double squaredError = 0;
+        for(size_t i = 0; i < projectedPts.size(); i++) {
+            cv::Point2f d = projectedPts[i] - imagePts[i];
+            squaredError += d.dot(d);
+        }
+        float error = sqrt(squaredError / projectedPts.size());
+
+        if(error > maxDrift) {
+            ofLogWarning("DriftMonitor") << "can't correct the extrinsics, reprojection error " << error
+                                         << ", the intrinsics may have changed too";
+            return;
+        }
+
+        rotCamToProj = rot;
+        transCamToProj = trans;
+
+        lock();
+        correctedRot = rot.clone();
+        correctedTrans = trans.clone();
+        bCorrectionReady = true;
+        numCorrections++;
+        unlock();
+
+        ofLogNotice("DriftMonitor") << "extrinsics corrected, reprojection error " << error;
+    }
+}
@@ -0,0 +1,97 @@
+/*
+ * ofxCvDriftMonitor.h
+ *
+ * Checks in the background that the camera -> projector extrinsics still hold
+ * during live projection : a sparse circles pattern is occasionally projected on
+ * the printed board, its reprojection error is measured against the calibration,
+ * and the extrinsics are re-estimated when it drifts above a bound.
+ */
+
+#pragma once
+
+#include "ofMain.h"
+#include "ofxCv.h"
+#include "ofxCvCameraProjectorCalibration.h"
+#include "ofxCvCalibrationSnapshot.h"
+
+namespace ofxCv {
+
+    class DriftMonitor : public ofThread {
+
+    public:
+        DriftMonitor();
+        ~DriftMonitor();
+
+        // takes a snapshot of the calibration and a copy of its board settings, the monitor
+        // thread never reads the calibration itself. Call it again after recalibrating.
+        // The printed board has to stay in view.
+        void setup(CameraProjectorCalibration & calibration);
+        void start();
+        void stop();
+
+        // fraction of one core the monitor may use, the rest of the time it sleeps
+        void setCpuBudget(float dutyCycle) { this->dutyCycle = ofClamp(dutyCycle, 0.001, 1); }
+        // minimum time between two checks, in seconds
+        void setCheckInterval(double seconds) { checkInterval = seconds; }
+        // projector pixels
+        void setMaxDrift(float pixels) { maxDrift = pixels; }
+        // consecutive drifted checks used to re-estimate the extrinsics
+        void setNumObservationsForCorrection(int num) { numObservationsForCorrection = MAX(1, num); }
+        void setAutoCorrect(bool enabled) { bAutoCorrect = enabled; }
+        void setLatency(double seconds);
+        void setCircleDetectionThreshold(int threshold) { circleDetectionThreshold = threshold; }
+
+        // renderer side : draw getPatternPoints() while a pattern is requested,
+        // and call patternDisplayed when it is first drawn
+        bool isPatternRequested();
+        const vector<cv::Point2f> & getPatternPoints() const { return patternPoints; }
+        void patternDisplayed(double displayTime);
+
+        // camera side : the frame is only copied when the monitor is waiting for it
+        void addFrame(const cv::Mat & camMat, double captureTime);
+
+        // applies a pending correction to the calibration, on the calling thread
+        bool update(CameraProjectorCalibration & calibration);
+
+        // last measured reprojection error in projector pixels, -1 before the first check
+        float getLastError();
+        int getNumChecks();
+        int getNumCorrections();
+
+    protected:
+        void threadedFunction();
+        bool measure(const cv::Mat & img, vector<cv::Point3f> & ptsInCam, float & error);
+        void correct();
+        void idle(double seconds);
+
+        // taken by setup, only read by the monitor thread
+        std::shared_ptr<const CalibrationSnapshot> snapshot;
+        // pattern settings only, the boards are dropped
+        CameraCalibration boardDetector;
+        cv::Size circlesPatternSize;
+        vector<cv::Point3f> boardPoints;
+        vector<cv::Point2f> patternPoints;
+        // the snapshot extrinsics, then the corrected ones
+        cv::Mat rotCamToProj, transCamToProj;
+
+        // shared with the main thread, guarded by the thread mutex
+        CaptureScheduler captureScheduler;
+        bool bPatternRequested;
+        cv::Mat pendingFrame;
+        bool bCorrectionReady;
+        cv::Mat correctedRot, correctedTrans;
+        float lastError;
+        int numChecks, numCorrections;
+
+        // monitor thread only
+        vector<vector<cv::Point3f> > driftedObservations;
+        cv::Mat processedImg;
+
+        float dutyCycle;
+        double checkInterval;
+        float maxDrift;
+        int numObservationsForCorrection;
+        bool bAutoCorrect;
+        int circleDetectionThreshold;
+    };
+}
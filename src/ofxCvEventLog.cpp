@@ -0,0 +1,100 @@
+/*
+ * ofxCvEventLog.cpp
+ *
+ * Fixed capacity ring buffer of typed calibration records. Writers never block
+ * or allocate, each slot is guarded by a sequence number so readers skip the
+ * records being overwritten, and the last N records are read in O(N).
+ */
+
+#include "ofxCvEventLog.h"
+
+namespace ofxCv {
+
+    EventLog::EventLog(size_t capacity)
+    :capacity(MAX(1, capacity))
+    ,slots(MAX(1, capacity))
+    ,head(0) {
+        for(size_t i = 0; i < slots.size(); i++) {
+            slots[i].sequence.store(0);
+        }
+    }
+
+    void EventLog::push(int type, int state, int numBoards, float value, const string & message){
+
+        unsigned long long index = head.fetch_add(1, std::memory_order_acq_rel);
+        Slot & slot = slots[index % capacity];
+
+        // a writer lapped by the others drops its record instead of waiting
+        unsigned long long sequence = slot.sequence.load(std::memory_order_relaxed);
+        if((sequence & 1) || sequence > 2 * index ||
+           !slot.sequence.compare_exchange_strong(sequence, 2 * index + 1, std::memory_order_relaxed)) {
+            return;
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+
+        Record & record = slot.record;
+        record.time = ofGetElapsedTimef();
+        record.type = type;
+        record.state = state;
+        record.numBoards = numBoards;
+        record.value = value;
+        size_t length = MIN(message.size(), sizeof(record.message) - 1);
+        memcpy(record.message, message.c_str(), length);
+        record.message[length] = '\0';
+
+        slot.sequence.store(2 * index + 2, std::memory_order_release);
+    }
+
+    size_t EventLog::getLast(size_t numRecords, vector<Record> & out) const {
+
+        unsigned long long end = head.load(std::memory_order_acquire);
+        unsigned long long count = MIN((unsigned long long) MIN(numRecords, capacity), end);
+
+        size_t numRead = 0;
+        for(unsigned long long index = end - count; index < end; index++) {
+            const Slot & slot = slots[index % capacity];
+            unsigned long long sequence = slot.sequence.load(std::memory_order_acquire);
+            // not written yet, or already overwritten
+            if(sequence != 2 * index + 2) continue;
+
+            Record record = slot.record;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if(slot.sequence.load(std::memory_order_relaxed) != sequence) continue;
+
+            out.push_back(record);
+            numRead++;
+        }
+        return numRead;
+    }
+
+    bool EventLog::exportCsv(const string & path, const vector<string> & typeNames,
+                             const vector<string> & stateNames, bool absolute) const {
+
+        vector<Record> records;
+        records.reserve(capacity);
+        getLast(capacity, records);
+
+        ofstream file(ofToDataPath(path, absolute).c_str());
+        if(!file.is_open()) {
+            ofLogError("EventLog") << "can't write " << path;
+            return false;
+        }
+        file << "time,type,state,numBoards,value,message\n";
+        for(size_t i = 0; i < records.size(); i++) {
+            const Record & record = records[i];
+            file << record.time << ",";
+            if(record.type >= 0 && record.type < (int) typeNames.size()) file << typeNames[record.type];
+            else file << record.type;
+            file << ",";
+            if(record.state >= 0 && record.state < (int) stateNames.size()) file << stateNames[record.state];
+            else file << record.state;
+            file << "," << record.numBoards << "," << record.value << ",";
+
+            // quoted, with the quotes doubled
+            string message = record.message;
+            ofStringReplace(message, "\"", "\"\"");
+            file << "\"" << message << "\"\n";
+        }
+        return true;
+    }
+}
@@ -0,0 +1,56 @@
+/*
+ * ofxCvEventLog.h
+ *
+ * Fixed capacity ring buffer of typed calibration records. Writers never block
+ * or allocate, each slot is guarded by a sequence number so readers skip the
+ * records being overwritten, and the last N records are read in O(N).
+ */
+
+#pragma once
+
+#include "ofMain.h"
+
+#include <atomic>
+
+namespace ofxCv {
+
+    class EventLog {
+
+    public:
+        struct Record {
+            double time;
+            int type;
+            int state;
+            int numBoards;
+            float value;
+            // truncated
+            char message[104];
+        };
+
+        EventLog(size_t capacity = 1024);
+
+        // wait-free, can be called from any thread
+        void push(int type, int state, int numBoards, float value, const string & message);
+
+        // appends up to numRecords of the latest records to out, oldest first
+        size_t getLast(size_t numRecords, vector<Record> & out) const;
+        // total number of records pushed, including the overwritten ones
+        unsigned long long getNumPushed() const { return head.load(std::memory_order_acquire); }
+        size_t getCapacity() const { return capacity; }
+
+        // the names are used instead of the numbers when given
+        bool exportCsv(const string & path, const vector<string> & typeNames = vector<string>(),
+                       const vector<string> & stateNames = vector<string>(), bool absolute = false) const;
+
+    protected:
+        struct Slot {
+            // 2 * index + 2 once record index is written, odd while it's being written
+            std::atomic<unsigned long long> sequence;
+            Record record;
+        };
+
+        size_t capacity;
+        vector<Slot> slots;
+        std::atomic<unsigned long long> head;
+    };
+}
@@ -0,0 +1,266 @@
+/*
+ * ofxCvMultiBoardDetector.cpp
+ *
+ * Finds several printed boards, and the circle grids projected on them, in a
+ * single camera frame : candidate regions are detected across a worker pool and
+ * each board is added as a separate observation.
+ */
+
+#include "ofxCvMultiBoardDetector.h"
+
+namespace ofxCv {
+
+    namespace {
+        cv::Point2f getCentroid(const vector<cv::Point2f> & pts) {
+            cv::Point2f sum(0, 0);
+            for(size_t i = 0; i < pts.size(); i++) sum += pts[i];
+            return pts.empty() ? sum : sum * (1.f / pts.size());
+        }
+
+        bool isLeftOf(const vector<cv::Point2f> & a, const vector<cv::Point2f> & b) {
+            return getCentroid(a).x < getCentroid(b).x;
+        }
+
+        bool isDetectionLeftOf(const MultiBoardDetector::Detection & a, const MultiBoardDetector::Detection & b) {
+            return isLeftOf(a.chessImgPts, b.chessImgPts);
+        }
+
+        bool isLarger(const cv::Rect & a, const cv::Rect & b) {
+            return a.area() > b.area();
+        }
+
+        // a grid found twice from overlapping regions is kept once
+        void addUnique(vector<vector<cv::Point2f> > & grids, vector<cv::Point2f> & pts) {
+            cv::Point2f center = getCentroid(pts);
+            for(size_t i = 0; i < grids.size(); i++) {
+                cv::Rect_<float> bounds = cv::boundingRect(grids[i]);
+                if(bounds.contains(center)) return;
+            }
+            grids.push_back(vector<cv::Point2f>());
+            grids.back().swap(pts);
+        }
+    }
+
+    MultiBoardDetector::MultiBoardDetector()
+    :calibration(NULL)
+    ,maxBoards(4)
+    ,circleDetectionThreshold(220)
+    ,minRegionSize(0.05) {
+    }
+
+    void MultiBoardDetector::setup(const CameraProjectorCalibration & calibration, int numThreads){
+        this->calibration = &calibration;
+        workers.setup(numThreads);
+    }
+
+    void MultiBoardDetector::setProjectedPatterns(const vector<vector<cv::Point2f> > & patterns){
+        projectedPatterns = patterns;
+        std::sort(projectedPatterns.begin(), projectedPatterns.end(), isLeftOf);
+    }
+
+    vector<vector<cv::Point2f> > MultiBoardDetector::makePatternRow(const vector<cv::Point2f> & pattern, cv::Size projectorSize, int count){
+        vector<vector<cv::Point2f> > patterns;
+        if(pattern.empty() || count < 1) return patterns;
+        cv::Rect_<float> bounds = cv::boundingRect(pattern);
+        float cellWidth = projectorSize.width / (float) count;
+        for(int i = 0; i < count; i++) {
+            cv::Point2f offset(cellWidth * (i + .5f) - (bounds.x + bounds.width / 2), 0);
+            patterns.push_back(pattern);
+            for(size_t j = 0; j < pattern.size(); j++) {
+                patterns.back()[j] += offset;
+            }
+        }
+        return patterns;
+    }
+
+    int MultiBoardDetector::detectBoards(const cv::Mat & img, vector<Detection> & detections, bool bParallel){
+        return detect(img, cv::Mat(), detections, bParallel);
+    }
+
+    int MultiBoardDetector::detectProjected(const cv::Mat & img, vector<Detection> & detections, bool bParallel){
+        if(calibration == NULL) {
+            detections.clear();
+            return 0;
+        }
+        cv::Mat processedImg;
+        calibration->processImageForCircleDetection(img, processedImg, circleDetectionThreshold);
+        return detect(img, processedImg, detections, bParallel);
+    }
+
+    void MultiBoardDetector::findRegions(const cv::Mat & mask, int kernelSize, vector<cv::Rect> & regions) const {
+        // merges the squares or circles of a grid into one blob
+        cv::Mat merged;
+        cv::morphologyEx(mask, merged, cv::MORPH_CLOSE,
+                         cv::getStructuringElement(cv::MORPH_RECT, cv::Size(kernelSize, kernelSize)));
+        vector<vector<cv::Point> > contours;
+        cv::findContours(merged, contours, CV_RETR_EXTERNAL, CV_CHAIN_APPROX_SIMPLE);
+
+        cv::Rect imageRect(0, 0, mask.cols, mask.rows);
+        float minSide = minRegionSize * MIN(mask.cols, mask.rows);
+        regions.clear();
+        for(size_t i = 0; i < contours.size(); i++) {
+            cv::Rect rect = cv::boundingRect(contours[i]);
+            if(rect.width < minSide || rect.height < minSide) continue;
+            // the detectors need the quiet zone around the grid
+            int dx = rect.width / 6, dy = rect.height / 6;
+            regions.push_back(cv::Rect(rect.x - dx, rect.y - dy, rect.width + 2 * dx, rect.height + 2 * dy) & imageRect);
+        }
+        std::sort(regions.begin(), regions.end(), isLarger);
+        if((int) regions.size() > 2 * maxBoards) regions.resize(2 * maxBoards);
+    }
+
+    void MultiBoardDetector::detectRegion(const cv::Mat & img, const cv::Mat & processedImg, const cv::Rect & region,
+                                          bool bCircles, vector<vector<cv::Point2f> > & grids) const {
+        grids.clear();
+        // boards held side by side end up in the same region : each grid found is
+        // painted over, on a copy, and the region searched again
+        cv::Mat roi = bCircles ? processedImg(region) : img(region);
+        for(int n = 0; n < maxBoards; n++) {
+            vector<cv::Point2f> pts;
+            bool bFound;
+            if(bCircles) {
+                bFound = cv::findCirclesGrid(roi, calibration->getCalibrationProjector().getPatternSize(),
+                                             pts, cv::CALIB_CB_ASYMMETRIC_GRID);
+            } else {
+                bFound = calibration->getCalibrationCamera().detectBoard(roi, pts);
+            }
+            if(!bFound) break;
+            if(n == 0) roi = roi.clone();
+
+            // the points are inside the grid, the hull is grown to cover its outer squares or circles
+            cv::Point2f center = getCentroid(pts);
+            vector<cv::Point2f> hull;
+            cv::convexHull(pts, hull);
+            vector<cv::Point> polygon(hull.size());
+            for(size_t i = 0; i < hull.size(); i++) {
+                polygon[i] = center + (hull[i] - center) * 1.4f;
+            }
+            cv::fillConvexPoly(roi, polygon, cv::Scalar::all(255));
+
+            for(size_t i = 0; i < pts.size(); i++) {
+                pts[i].x += region.x;
+                pts[i].y += region.y;
+            }
+            grids.push_back(pts);
+        }
+    }
+
+    int MultiBoardDetector::detect(const cv::Mat & img, const cv::Mat & processedImg, vector<Detection> & detections, bool bParallel){
+
+        detections.clear();
+        if(calibration == NULL || img.empty()) return 0;
+
+        cv::Mat gray;
+        if(img.channels() == 3) cvtColor(img, gray, CV_RGB2GRAY);
+        else if(img.channels() == 4) cvtColor(img, gray, CV_RGBA2GRAY);
+        else gray = img;
+
+        // dark squares for the boards, bright circles for the projected grids
+        int minSide = MIN(img.cols, img.rows);
+        vector<cv::Rect> boardRegions, circleRegions;
+        cv::Mat mask;
+        cv::adaptiveThreshold(gray, mask, 255, cv::ADAPTIVE_THRESH_MEAN_C, cv::THRESH_BINARY_INV, (minSide / 16) | 1, 10);
+        findRegions(mask, MAX(3, minSide / 40), boardRegions);
+        bool bProjected = !processedImg.empty();
+        if(bProjected) {
+            cv::bitwise_not(processedImg, mask);
+            findRegions(mask, MAX(3, minSide / 25), circleRegions);
+        }
+
+        int numBoardRegions = boardRegions.size();
+        int numTasks = numBoardRegions + circleRegions.size();
+        vector<vector<vector<cv::Point2f> > > found(numTasks);
+        std::function<void(int)> task = [&](int i) {
+            if(i < numBoardRegions) detectRegion(img, processedImg, boardRegions[i], false, found[i]);
+            else detectRegion(img, processedImg, circleRegions[i - numBoardRegions], true, found[i]);
+        };
+        if(bParallel) {
+            workers.parallelFor(numTasks, task);
+        } else {
+            for(int i = 0; i < numTasks; i++) task(i);
+        }
+
+        // largest regions first, so a board found in a merged region wins over its parts
+        vector<vector<cv::Point2f> > boards, grids;
+        for(int i = 0; i < numTasks; i++) {
+            for(size_t j = 0; j < found[i].size(); j++) {
+                addUnique(i < numBoardRegions ? boards : grids, found[i][j]);
+            }
+        }
+        // no candidate region held a board : whole frame, like findBoard
+        cv::Rect imageRect(0, 0, img.cols, img.rows);
+        if(boards.empty()) {
+            detectRegion(img, processedImg, imageRect, false, boards);
+        }
+        if(bProjected && grids.empty()) {
+            detectRegion(img, processedImg, imageRect, true, grids);
+        }
+        if((int) boards.size() > maxBoards) boards.resize(maxBoards);
+
+        if(!bProjected) {
+            detections.resize(boards.size());
+            for(size_t i = 0; i < boards.size(); i++) {
+                detections[i].chessImgPts.swap(boards[i]);
+                detections[i].region = cv::boundingRect(detections[i].chessImgPts);
+            }
+            std::sort(detections.begin(), detections.end(), isDetectionLeftOf);
+            return detections.size();
+        }
+
+        // each grid goes to the nearest board, closest pairs first
+        vector<pair<float, pair<int, int> > > distances;
+        for(size_t i = 0; i < grids.size(); i++) {
+            cv::Point2f center = getCentroid(grids[i]);
+            for(size_t j = 0; j < boards.size(); j++) {
+                float distance = cv::norm(center - getCentroid(boards[j]));
+                distances.push_back(make_pair(distance, make_pair((int) i, (int) j)));
+            }
+        }
+        std::sort(distances.begin(), distances.end());
+        vector<bool> bGridUsed(grids.size(), false), bBoardUsed(boards.size(), false);
+        for(size_t i = 0; i < distances.size(); i++) {
+            int grid = distances[i].second.first, board = distances[i].second.second;
+            if(bGridUsed[grid] || bBoardUsed[board]) continue;
+            bGridUsed[grid] = bBoardUsed[board] = true;
+            Detection detection;
+            detection.chessImgPts = boards[board];
+            detection.circlesImgPts = grids[grid];
+            detection.region = cv::boundingRect(detection.chessImgPts);
+            detections.push_back(detection);
+        }
+
+        // the projector & camera see the row of patterns in the same order
+        std::sort(detections.begin(), detections.end(), isDetectionLeftOf);
+        if(projectedPatterns.empty() && detections.size() == 1) {
+            detections[0].projectorImgPts = calibration->getCalibrationProjector().getCandidateImagePoints();
+        } else if(projectedPatterns.size() == detections.size()) {
+            for(size_t i = 0; i < detections.size(); i++) {
+                detections[i].projectorImgPts = projectedPatterns[i];
+            }
+        } else {
+            ofLogVerbose("MultiBoardDetector") << detections.size() << " projected grids found for "
+                                               << projectedPatterns.size() << " patterns, skipping";
+            detections.clear();
+        }
+        return detections.size();
+    }
+
+    int MultiBoardDetector::addBoards(CameraCalibration & calibrationCamera, const vector<Detection> & detections, cv::Size imageSize){
+        for(size_t i = 0; i < detections.size(); i++) {
+            calibrationCamera.addImagePoints(detections[i].chessImgPts, imageSize);
+        }
+        return detections.size();
+    }
+
+    int MultiBoardDetector::addProjected(CameraProjectorCalibration & calibration, const vector<Detection> & detections){
+        ProjectorCalibration & calibrationProjector = calibration.getCalibrationProjector();
+        vector<cv::Point2f> candidateImagePoints = calibrationProjector.getCandidateImagePoints();
+        int added = 0;
+        for(size_t i = 0; i < detections.size(); i++) {
+            calibrationProjector.setCandidateImagePoints(detections[i].projectorImgPts);
+            if(calibration.addProjected(detections[i].chessImgPts, detections[i].circlesImgPts)) added++;
+        }
+        calibrationProjector.setCandidateImagePoints(candidateImagePoints);
+        return added;
+    }
+}
@@ -0,0 +1,71 @@
+/*
+ * ofxCvMultiBoardDetector.h
+ *
+ * Finds several printed boards, and the circle grids projected on them, in a
+ * single camera frame : candidate regions are detected across a worker pool and
+ * each board is added as a separate observation.
+ */
+
+#pragma once
+
+#include "ofMain.h"
+#include "ofxCv.h"
+#include "ofxCvCameraProjectorCalibration.h"
+#include "ofxCvWorkerPool.h"
+
+namespace ofxCv {
+
+    class MultiBoardDetector {
+
+    public:
+        struct Detection {
+            // bounding box of the board corners in the camera image
+            cv::Rect region;
+            vector<cv::Point2f> chessImgPts;
+            // projector frames only : the circles found next to the board and
+            // the projector pattern they were matched to
+            vector<cv::Point2f> circlesImgPts;
+            vector<cv::Point2f> projectorImgPts;
+        };
+
+        MultiBoardDetector();
+
+        // the calibration gives the board & circle patterns and must outlive the detector,
+        // 0 threads : one per hardware core
+        void setup(const CameraProjectorCalibration & calibration, int numThreads = 0);
+        void setMaxBoards(int maxBoards) { this->maxBoards = MAX(1, maxBoards); }
+        void setCircleDetectionThreshold(int threshold) { circleDetectionThreshold = threshold; }
+        // regions smaller than this fraction of the image side are skipped
+        void setMinRegionSize(float fraction) { minRegionSize = fraction; }
+
+        // one pattern per board displayed during the capture. Boards and patterns are
+        // matched left to right, so the frame must show as many grids as patterns
+        void setProjectedPatterns(const vector<vector<cv::Point2f> > & patterns);
+        const vector<vector<cv::Point2f> > & getProjectedPatterns() const { return projectedPatterns; }
+        // count copies of a pattern spread evenly across the projector width
+        static vector<vector<cv::Point2f> > makePatternRow(const vector<cv::Point2f> & pattern, cv::Size projectorSize, int count);
+
+        // boards sorted left to right, returns how many were found. With bParallel
+        // false the regions are processed on the calling thread, which makes these
+        // safe to call from worker threads (e.g. one frame per thread)
+        int detectBoards(const cv::Mat & img, vector<Detection> & detections, bool bParallel = true);
+        int detectProjected(const cv::Mat & img, vector<Detection> & detections, bool bParallel = true);
+
+        // each detection as a separate board, returns how many were added
+        static int addBoards(CameraCalibration & calibrationCamera, const vector<Detection> & detections, cv::Size imageSize);
+        static int addProjected(CameraProjectorCalibration & calibration, const vector<Detection> & detections);
+
+    protected:
+        int detect(const cv::Mat & img, const cv::Mat & processedImg, vector<Detection> & detections, bool bParallel);
+        void findRegions(const cv::Mat & mask, int kernelSize, vector<cv::Rect> & regions) const;
+        void detectRegion(const cv::Mat & img, const cv::Mat & processedImg, const cv::Rect & region,
+                          bool bCircles, vector<vector<cv::Point2f> > & grids) const;
+
+        const CameraProjectorCalibration * calibration;
+        WorkerPool workers;
+        vector<vector<cv::Point2f> > projectedPatterns;
+        int maxBoards;
+        int circleDetectionThreshold;
+        float minRegionSize;
+    };
+}
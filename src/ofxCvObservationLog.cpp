@@ -0,0 +1,226 @@
+/*
+ * ofxCvObservationLog.cpp
+ *
+ * Append-only log of the observations accepted during a calibration session.
+ * Each record is checksummed and synced to disk when written, so after a crash
+ * the session is resumed by replaying the valid records, without any detection.
+ */
+
+#include "ofxCvObservationLog.h"
+
+#ifdef TARGET_WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace ofxCv {
+
+    namespace {
+        // record : magic, payload size, payload, checksum of the payload
+        const unsigned int recordMagic = 0x5642534f; // "OSBV"
+        const size_t recordOverhead = 3 * sizeof(unsigned int);
+
+        unsigned int checksum(const char * data, size_t size) {
+            // FNV-1a
+            unsigned int hash = 2166136261u;
+            for(size_t i = 0; i < size; i++) {
+                hash ^= (unsigned char) data[i];
+                hash *= 16777619u;
+            }
+            return hash;
+        }
+
+        class Writer {
+        public:
+            template <class T> void write(const T & value) {
+                const char * p = (const char *) &value;
+                data.insert(data.end(), p, p + sizeof(T));
+            }
+            template <class T> void write(const vector<T> & values) {
+                write((unsigned int) values.size());
+                if(values.empty()) return;
+                const char * p = (const char *) &values[0];
+                data.insert(data.end(), p, p + values.size() * sizeof(T));
+            }
+            void write(const cv::Mat & vec) {
+                vector<double> values;
+                if(!vec.empty()) {
+                    cv::Mat vec64;
+                    vec.reshape(1, vec.total()).convertTo(vec64, CV_64F);
+                    values.assign(vec64.begin<double>(), vec64.end<double>());
+                }
+                write(values);
+            }
+            vector<char> data;
+        };
+
+        class Reader {
+        public:
+            Reader(const char * data, size_t size) : data(data), size(size), pos(0), bValid(true) {}
+            template <class T> void read(T & value) {
+                if(!bValid || pos + sizeof(T) > size) { bValid = false; return; }
+                memcpy(&value, data + pos, sizeof(T));
+                pos += sizeof(T);
+            }
+            template <class T> void read(vector<T> & values) {
+                unsigned int n = 0;
+                read(n);
+                if(!bValid || pos + (size_t) n * sizeof(T) > size) { bValid = false; return; }
+                values.resize(n);
+                if(n > 0) memcpy(&values[0], data + pos, n * sizeof(T));
+                pos += n * sizeof(T);
+            }
+            void read(cv::Mat & vec) {
+                vector<double> values;
+                read(values);
+                vec = values.empty() ? cv::Mat() : cv::Mat(values, true);
+            }
+            const char * data;
+            size_t size, pos;
+            bool bValid;
+        };
+
+        void serialize(const Observation & observation, Writer & writer) {
+            writer.write((int) observation.type);
+            writer.write(observation.state);
+            writer.write(observation.imageSize.width);
+            writer.write(observation.imageSize.height);
+            writer.write(observation.cameraImagePoints);
+            writer.write(observation.cameraObjectPoints);
+            writer.write(observation.boardRot);
+            writer.write(observation.boardTrans);
+            writer.write(observation.projectorImagePoints);
+            writer.write(observation.projectorObjectPoints);
+        }
+
+        bool deserialize(Reader & reader, Observation & observation) {
+            int type = 0;
+            reader.read(type);
+            observation.type = (Observation::Type) type;
+            reader.read(observation.state);
+            reader.read(observation.imageSize.width);
+            reader.read(observation.imageSize.height);
+            reader.read(observation.cameraImagePoints);
+            reader.read(observation.cameraObjectPoints);
+            reader.read(observation.boardRot);
+            reader.read(observation.boardTrans);
+            reader.read(observation.projectorImagePoints);
+            reader.read(observation.projectorObjectPoints);
+            return reader.bValid && reader.pos == reader.size;
+        }
+    }
+
+    ObservationLog::ObservationLog()
+    :file(NULL) {
+    }
+
+    ObservationLog::~ObservationLog(){
+        close();
+    }
+
+    bool ObservationLog::open(const string & path, bool absolute){
+        close();
+        this->path = ofToDataPath(path, absolute);
+
+        // cuts a torn last record in place, the valid records are never rewritten
+        vector<Observation> observations;
+        size_t validSize = read(this->path, observations, true);
+        ofFile existing(this->path);
+        if(existing.exists() && existing.getSize() != validSize) {
+            ofLogWarning("ObservationLog") << "discarding " << existing.getSize() - validSize
+                                           << " bytes of incomplete record at the end of " << path;
+            FILE * truncated = fopen(this->path.c_str(), "r+b");
+            if(truncated == NULL) return false;
+#ifdef TARGET_WIN32
+            bool bTruncated = _chsize(_fileno(truncated), validSize) == 0;
+            _commit(_fileno(truncated));
+#else
+            bool bTruncated = ftruncate(fileno(truncated), validSize) == 0;
+            fsync(fileno(truncated));
+#endif
+            fclose(truncated);
+            if(!bTruncated) {
+                ofLogError("ObservationLog") << "can't truncate " << this->path;
+                return false;
+            }
+        }
+
+        file = fopen(this->path.c_str(), "ab");
+        if(file == NULL) {
+            ofLogError("ObservationLog") << "can't open " << this->path;
+            return false;
+        }
+        return true;
+    }
+
+    bool ObservationLog::clear(){
+        if(path.empty()) return false;
+        close();
+        FILE * emptied = fopen(path.c_str(), "wb");
+        if(emptied == NULL) return false;
+        fclose(emptied);
+        file = fopen(path.c_str(), "ab");
+        return file != NULL;
+    }
+
+    void ObservationLog::close(){
+        if(file != NULL) {
+            fclose(file);
+            file = NULL;
+        }
+    }
+
+    bool ObservationLog::append(const Observation & observation){
+        if(file == NULL) return false;
+
+        Writer payload;
+        serialize(observation, payload);
+
+        Writer record;
+        record.write(recordMagic);
+        record.write((unsigned int) payload.data.size());
+        record.data.insert(record.data.end(), payload.data.begin(), payload.data.end());
+        record.write(checksum(&payload.data[0], payload.data.size()));
+
+        if(fwrite(&record.data[0], 1, record.data.size(), file) != record.data.size()) {
+            ofLogError("ObservationLog") << "can't write to " << path;
+            return false;
+        }
+        fflush(file);
+#ifdef TARGET_WIN32
+        _commit(_fileno(file));
+#else
+        fsync(fileno(file));
+#endif
+        return true;
+    }
+
+    size_t ObservationLog::read(const string & path, vector<Observation> & observations, bool absolute){
+        observations.clear();
+
+        if(!ofFile::doesFileExist(path, !absolute)) return 0;
+        ofBuffer buffer = ofBufferFromFile(ofToDataPath(path, absolute), true);
+
+        const char * data = buffer.getBinaryBuffer();
+        size_t size = buffer.size();
+        size_t pos = 0;
+        while(pos + recordOverhead <= size) {
+            unsigned int magic, payloadSize, sum;
+            memcpy(&magic, data + pos, sizeof(unsigned int));
+            memcpy(&payloadSize, data + pos + sizeof(unsigned int), sizeof(unsigned int));
+            if(magic != recordMagic || pos + recordOverhead + payloadSize > size) break;
+
+            const char * payload = data + pos + 2 * sizeof(unsigned int);
+            memcpy(&sum, payload + payloadSize, sizeof(unsigned int));
+            if(sum != checksum(payload, payloadSize)) break;
+
+            Reader reader(payload, payloadSize);
+            Observation observation;
+            if(!deserialize(reader, observation)) break;
+            observations.push_back(observation);
+            pos += recordOverhead + payloadSize;
+        }
+        return pos;
+    }
+}
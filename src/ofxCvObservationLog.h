@@ -0,0 +1,59 @@
+/*
+ * ofxCvObservationLog.h
+ *
+ * Append-only log of the observations accepted during a calibration session.
+ * Each record is checksummed and synced to disk when written, so after a crash
+ * the session is resumed by replaying the valid records, without any detection.
+ */
+
+#pragma once
+
+#include "ofMain.h"
+#include "ofxCv.h"
+
+namespace ofxCv {
+
+    struct Observation {
+        enum Type {
+            STATE = 1,
+            CAMERA_BOARD,
+            PROJECTOR_BOARD
+        };
+        Observation() : type(STATE), state(0) {}
+
+        Type type;
+        // STATE : calibration state entered
+        int state;
+        cv::Size imageSize;
+        vector<cv::Point2f> cameraImagePoints;
+        vector<cv::Point3f> cameraObjectPoints;
+        // PROJECTOR_BOARD only
+        cv::Mat boardRot, boardTrans;
+        vector<cv::Point2f> projectorImagePoints;
+        vector<cv::Point3f> projectorObjectPoints;
+    };
+
+    class ObservationLog {
+
+    public:
+        ObservationLog();
+        ~ObservationLog();
+
+        // opens for appending, a torn record left by a crash is cut off
+        bool open(const string & path, bool absolute = false);
+        // empties the log, e.g. to start a new session
+        bool clear();
+        void close();
+        bool isOpen() const { return file != NULL; }
+
+        // returns once the record is on disk
+        bool append(const Observation & observation);
+
+        // reads every complete record, returns the size in bytes of the valid part
+        static size_t read(const string & path, vector<Observation> & observations, bool absolute = false);
+
+    protected:
+        string path;
+        FILE * file;
+    };
+}
@@ -0,0 +1,110 @@
+/*
+ * ofxCvPatternRasterizer.cpp
+ *
+ * Rasterizes the projector calibration pattern (anti-aliased discs at the
+ * candidate image points) into an image at projector resolution, only
+ * redrawing the regions around the points that moved since the last update.
+ */
+
+#include "ofxCvPatternRasterizer.h"
+
+namespace ofxCv {
+
+    PatternRasterizer::PatternRasterizer()
+    :radius(4)
+    ,background(0)
+    ,foreground(255) {
+    }
+
+    void PatternRasterizer::setup(int width, int height, float radius, unsigned char background, unsigned char foreground){
+        this->radius = radius;
+        this->background = background;
+        this->foreground = foreground;
+        image.create(height, width, CV_8UC1);
+        redraw();
+    }
+
+    void PatternRasterizer::setRadius(float radius){
+        this->radius = radius;
+        redraw();
+    }
+
+    cv::Rect PatternRasterizer::getBounds(const cv::Point2f & point) const {
+        // one extra pixel for the anti-aliased edge
+        int x0 = floor(point.x - radius - 1), y0 = floor(point.y - radius - 1);
+        int x1 = ceil(point.x + radius + 1), y1 = ceil(point.y + radius + 1);
+        return cv::Rect(x0, y0, x1 - x0, y1 - y0) & cv::Rect(0, 0, image.cols, image.rows);
+    }
+
+    void PatternRasterizer::addDirtyRect(const cv::Rect & rect){
+        if(rect.area() == 0) return;
+        // merges with the overlapping regions so no pixel is drawn twice
+        cv::Rect merged = rect;
+        for(int i = dirtyRects.size() - 1; i >= 0; i--) {
+            if((dirtyRects[i] & merged).area() > 0) {
+                merged |= dirtyRects[i];
+                dirtyRects.erase(dirtyRects.begin() + i);
+                i = dirtyRects.size();
+            }
+        }
+        dirtyRects.push_back(merged);
+    }
+
+    void PatternRasterizer::redraw(){
+        dirtyRects.clear();
+        if(image.empty()) return;
+        addDirtyRect(cv::Rect(0, 0, image.cols, image.rows));
+        image.setTo(background);
+        for(size_t i = 0; i < points.size(); i++) {
+            drawDisc(points[i], dirtyRects[0]);
+        }
+    }
+
+    bool PatternRasterizer::update(const vector<cv::Point2f> & newPoints){
+        dirtyRects.clear();
+
+        if(newPoints.size() != points.size()) {
+            points = newPoints;
+            redraw();
+            return true;
+        }
+
+        for(size_t i = 0; i < points.size(); i++) {
+            cv::Point2f d = newPoints[i] - points[i];
+            if(d.dot(d) > 1e-6) {
+                addDirtyRect(getBounds(points[i]));
+                addDirtyRect(getBounds(newPoints[i]));
+            }
+        }
+        if(dirtyRects.empty()) return false;
+
+        points = newPoints;
+        for(size_t r = 0; r < dirtyRects.size(); r++) {
+            const cv::Rect & rect = dirtyRects[r];
+            image(rect).setTo(background);
+            for(size_t i = 0; i < points.size(); i++) {
+                if((getBounds(points[i]) & rect).area() > 0) {
+                    drawDisc(points[i], rect);
+                }
+            }
+        }
+        return true;
+    }
+
+    void PatternRasterizer::drawDisc(const cv::Point2f & center, const cv::Rect & clip){
+        cv::Rect rect = getBounds(center) & clip;
+        float delta = foreground - background;
+        for(int y = rect.y; y < rect.y + rect.height; y++) {
+            unsigned char * row = image.ptr<unsigned char>(y);
+            float dy = y + .5f - center.y;
+            for(int x = rect.x; x < rect.x + rect.width; x++) {
+                float dx = x + .5f - center.x;
+                // approximate pixel coverage of the disc edge
+                float coverage = ofClamp(radius + .5f - sqrtf(dx * dx + dy * dy), 0, 1);
+                if(coverage == 0) continue;
+                unsigned char value = background + delta * coverage + .5f;
+                row[x] = delta > 0 ? MAX(row[x], value) : MIN(row[x], value);
+            }
+        }
+    }
+}
@@ -0,0 +1,43 @@
+/*
+ * ofxCvPatternRasterizer.h
+ *
+ * Rasterizes the projector calibration pattern (anti-aliased discs at the
+ * candidate image points) into an image at projector resolution, only
+ * redrawing the regions around the points that moved since the last update.
+ */
+
+#pragma once
+
+#include "ofMain.h"
+#include "ofxCv.h"
+
+namespace ofxCv {
+
+    class PatternRasterizer {
+
+    public:
+        PatternRasterizer();
+
+        void setup(int width, int height, float radius = 4, unsigned char background = 0, unsigned char foreground = 255);
+        void setRadius(float radius);
+
+        // returns true if the image changed, getDirtyRects then lists the modified regions
+        bool update(const vector<cv::Point2f> & points);
+        void redraw();
+
+        // CV_8UC1, projector resolution
+        const cv::Mat & getImage() const { return image; }
+        const vector<cv::Rect> & getDirtyRects() const { return dirtyRects; }
+
+    protected:
+        cv::Rect getBounds(const cv::Point2f & point) const;
+        void addDirtyRect(const cv::Rect & rect);
+        void drawDisc(const cv::Point2f & center, const cv::Rect & clip);
+
+        cv::Mat image;
+        vector<cv::Point2f> points;
+        vector<cv::Rect> dirtyRects;
+        float radius;
+        unsigned char background, foreground;
+    };
+}
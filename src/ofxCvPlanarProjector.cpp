@@ -0,0 +1,105 @@
+/*
+ * ofxCvPlanarProjector.cpp
+ *
+ * Fast projection of points lying on a plane (z = 0 in the object frame, like
+ * backProject assumes) : a homography maps the plane to ideal projector pixels
+ * and a precomputed grid adds the projector lens distortion.
+ */
+
+#include "ofxCvPlanarProjector.h"
+
+namespace ofxCv {
+
+    PlanarProjector::PlanarProjector()
+    :homography(cv::Matx33f::eye())
+    ,gridCols(0)
+    ,gridRows(0)
+    ,gridStep(16)
+    ,maxGridError(0) {
+    }
+
+    void PlanarProjector::setup(const CameraProjectorCalibration & calibration, int gridStep){
+
+        const ProjectorCalibration & calibrationProjector = calibration.getCalibrationProjector();
+        projectorMatrix = calibrationProjector.getDistortedIntrinsics().getCameraMatrix();
+        projectorDistCoeffs = calibrationProjector.getDistCoeffs().clone();
+        cv::Rodrigues(calibration.getCamToProjRotation(), rotCamToProj);
+        cv::Mat_<double> trans = calibration.getCamToProjTranslation();
+        transCamToProj = cv::Vec3d(trans(0), trans(1), trans(2));
+
+        // covers the projector image plus a margin for shapes partly outside of it
+        cv::Size imageSize = calibrationProjector.getDistortedIntrinsics().getImageSize();
+        this->gridStep = MAX(1, gridStep);
+        float margin = MAX(imageSize.width, imageSize.height) / 8;
+        gridOrigin = cv::Point2f(-margin, -margin);
+        gridCols = ceil((imageSize.width + 2 * margin) / this->gridStep) + 1;
+        gridRows = ceil((imageSize.height + 2 * margin) / this->gridStep) + 1;
+
+        vector<cv::Point2f> nodes(gridCols * gridRows);
+        for(int y = 0; y < gridRows; y++) {
+            for(int x = 0; x < gridCols; x++) {
+                nodes[y * gridCols + x] = gridOrigin + cv::Point2f(x, y) * this->gridStep;
+            }
+        }
+        distort(nodes, grid);
+        for(size_t i = 0; i < nodes.size(); i++) {
+            grid[i] -= nodes[i];
+        }
+
+        // checks the interpolation at the cell centers, where it's the least accurate
+        vector<cv::Point2f> centers, distortedCenters;
+        for(int y = 0; y < gridRows - 1; y++) {
+            for(int x = 0; x < gridCols - 1; x++) {
+                centers.push_back(gridOrigin + cv::Point2f(x + .5f, y + .5f) * this->gridStep);
+            }
+        }
+        distort(centers, distortedCenters);
+        maxGridError = 0;
+        for(size_t i = 0; i < centers.size(); i++) {
+            cv::Point2f d = centers[i] + getDistortionOffset(centers[i].x, centers[i].y) - distortedCenters[i];
+            maxGridError = MAX(maxGridError, sqrtf(d.dot(d)));
+        }
+        ofLogVerbose("PlanarProjector") << "distortion grid " << gridCols << "x" << gridRows
+                                        << ", max error " << maxGridError << "px";
+    }
+
+    void PlanarProjector::distort(const vector<cv::Point2f> & idealPts, vector<cv::Point2f> & distortedPts) const {
+        cv::Matx33d projectorMatrixInv = projectorMatrix.inv();
+        vector<cv::Point3f> rays(idealPts.size());
+        for(size_t i = 0; i < idealPts.size(); i++) {
+            cv::Vec3d ray = projectorMatrixInv * cv::Vec3d(idealPts[i].x, idealPts[i].y, 1);
+            rays[i] = cv::Point3f(ray[0], ray[1], ray[2]);
+        }
+        cv::projectPoints(cv::Mat(rays), cv::Mat::zeros(3, 1, CV_64F), cv::Mat::zeros(3, 1, CV_64F),
+                          cv::Mat(projectorMatrix), projectorDistCoeffs, distortedPts);
+    }
+
+    void PlanarProjector::setPose(const cv::Mat & rotObjToCam, const cv::Mat & transObjToCam){
+        cv::Matx33d rotObjToCam3x3;
+        cv::Rodrigues(rotObjToCam, rotObjToCam3x3);
+        cv::Mat_<double> trans = transObjToCam;
+
+        cv::Matx33d rot = rotCamToProj * rotObjToCam3x3;
+        cv::Vec3d t = rotCamToProj * cv::Vec3d(trans(0), trans(1), trans(2)) + transCamToProj;
+
+        // plane points (x, y, 0) -> K [r1 r2 t] (x, y, 1)
+        cv::Matx33d planeToProj(rot(0, 0), rot(0, 1), t[0],
+                                rot(1, 0), rot(1, 1), t[1],
+                                rot(2, 0), rot(2, 1), t[2]);
+        homography = projectorMatrix * planeToProj;
+    }
+
+    void PlanarProjector::project(const vector<cv::Point2f> & planePts, vector<cv::Point2f> & out) const {
+        out.resize(planePts.size());
+        for(size_t i = 0; i < planePts.size(); i++) {
+            out[i] = project(planePts[i]);
+        }
+    }
+
+    void PlanarProjector::project(const vector<cv::Point3f> & planePts, vector<cv::Point2f> & out) const {
+        out.resize(planePts.size());
+        for(size_t i = 0; i < planePts.size(); i++) {
+            out[i] = project(cv::Point2f(planePts[i].x, planePts[i].y));
+        }
+    }
+}
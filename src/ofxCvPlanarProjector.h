@@ -0,0 +1,73 @@
+/*
+ * ofxCvPlanarProjector.h
+ *
+ * Fast projection of points lying on a plane (z = 0 in the object frame, like
+ * backProject assumes) : a homography maps the plane to ideal projector pixels
+ * and a precomputed grid adds the projector lens distortion.
+ */
+
+#pragma once
+
+#include "ofMain.h"
+#include "ofxCv.h"
+#include "ofxCvCameraProjectorCalibration.h"
+
+namespace ofxCv {
+
+    class PlanarProjector {
+
+    public:
+        PlanarProjector();
+
+        // builds the distortion grid, one node every gridStep projector pixels
+        void setup(const CameraProjectorCalibration & calibration, int gridStep = 16);
+        // plane pose in the camera frame, only needs to be called when it changes
+        void setPose(const cv::Mat & rotObjToCam, const cv::Mat & transObjToCam);
+
+        cv::Point2f project(const cv::Point2f & planePt) const;
+        void project(const vector<cv::Point2f> & planePts, vector<cv::Point2f> & out) const;
+        // z is ignored
+        void project(const vector<cv::Point3f> & planePts, vector<cv::Point2f> & out) const;
+
+        const cv::Matx33f & getHomography() const { return homography; }
+        // largest distance in pixels between the grid and the distortion model, sampled between nodes
+        float getMaxGridError() const { return maxGridError; }
+
+    protected:
+        cv::Point2f getDistortionOffset(float x, float y) const;
+        void distort(const vector<cv::Point2f> & idealPts, vector<cv::Point2f> & distortedPts) const;
+
+        cv::Matx33d projectorMatrix;
+        cv::Mat projectorDistCoeffs;
+        cv::Matx33d rotCamToProj;
+        cv::Vec3d transCamToProj;
+        cv::Matx33f homography;
+
+        // distorted - ideal pixel position, on a regular grid over the ideal projector image
+        vector<cv::Point2f> grid;
+        int gridCols, gridRows;
+        float gridStep;
+        cv::Point2f gridOrigin;
+        float maxGridError;
+    };
+
+    inline cv::Point2f PlanarProjector::project(const cv::Point2f & pt) const {
+        const cv::Matx33f & h = homography;
+        float w = 1.f / (h(2, 0) * pt.x + h(2, 1) * pt.y + h(2, 2));
+        float x = (h(0, 0) * pt.x + h(0, 1) * pt.y + h(0, 2)) * w;
+        float y = (h(1, 0) * pt.x + h(1, 1) * pt.y + h(1, 2)) * w;
+        return cv::Point2f(x, y) + getDistortionOffset(x, y);
+    }
+
+    inline cv::Point2f PlanarProjector::getDistortionOffset(float x, float y) const {
+        // bilinear interpolation, clamped to the grid border
+        float gx = ofClamp((x - gridOrigin.x) / gridStep, 0, gridCols - 1.001f);
+        float gy = ofClamp((y - gridOrigin.y) / gridStep, 0, gridRows - 1.001f);
+        int ix = gx, iy = gy;
+        float fx = gx - ix, fy = gy - iy;
+        const cv::Point2f * row = &grid[iy * gridCols + ix];
+        cv::Point2f top = row[0] * (1 - fx) + row[1] * fx;
+        cv::Point2f bottom = row[gridCols] * (1 - fx) + row[gridCols + 1] * fx;
+        return top * (1 - fy) + bottom * fy;
+    }
+}
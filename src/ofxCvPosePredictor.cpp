@@ -0,0 +1,154 @@
+/*
+ * ofxCvPosePredictor.cpp
+ *
+ * Constant-velocity Kalman filter on object poses (rotation vector + translation)
+ * used to extrapolate tracked poses to the time the projector actually displays them.
+ */
+
+#include "ofxCvPosePredictor.h"
+
+namespace ofxCv {
+
+    namespace {
+
+        cv::Matx33d expSO3(const cv::Vec3d & w){
+            cv::Matx33d R;
+            cv::Rodrigues(w, R);
+            return R;
+        }
+
+        cv::Vec3d logSO3(const cv::Matx33d & R){
+            cv::Vec3d w;
+            cv::Rodrigues(R, w);
+            return w;
+        }
+
+        cv::Vec3d toVec3d(const cv::Mat & m){
+            cv::Mat m64;
+            m.convertTo(m64, CV_64F);
+            return cv::Vec3d(m64.at<double>(0), m64.at<double>(1), m64.at<double>(2));
+        }
+    }
+
+    PosePredictor::PosePredictor()
+    :latency(0)
+    ,translationProcessNoise(50)
+    ,rotationProcessNoise(10)
+    ,translationMeasurementNoise(0.2)
+    ,rotationMeasurementNoise(0.01) {
+        reset();
+    }
+
+    void PosePredictor::reset(){
+        bInitialized = false;
+        lastTimestamp = 0;
+        translation = velocity = angularVelocity = cv::Vec3d(0, 0, 0);
+        rotation = cv::Matx33d::eye();
+    }
+
+    void PosePredictor::setProcessNoise(double translation, double rotation){
+        translationProcessNoise = translation;
+        rotationProcessNoise = rotation;
+    }
+
+    void PosePredictor::setMeasurementNoise(double translation, double rotation){
+        translationMeasurementNoise = translation;
+        rotationMeasurementNoise = rotation;
+    }
+
+    void PosePredictor::predictAxis(AxisCovariance & c, double dt, double q) const {
+        // P = F P F^t + Q with F = [1 dt; 0 1] and white-noise acceleration Q
+        double dt2 = dt * dt, dt3 = dt2 * dt;
+        double pp = c.pp + 2 * dt * c.pv + dt2 * c.vv;
+        double pv = c.pv + dt * c.vv;
+        c.pp = pp + q * dt3 / 3.;
+        c.pv = pv + q * dt2 / 2.;
+        c.vv = c.vv + q * dt;
+    }
+
+    void PosePredictor::correctAxis(AxisCovariance & c, double innovation, double r,
+                                    double & posCorrection, double & velCorrection) const {
+        double s = c.pp + r;
+        double kp = c.pp / s;
+        double kv = c.pv / s;
+        posCorrection = kp * innovation;
+        velCorrection = kv * innovation;
+        AxisCovariance updated;
+        updated.pp = (1 - kp) * c.pp;
+        updated.pv = (1 - kp) * c.pv;
+        updated.vv = c.vv - kv * c.pv;
+        c = updated;
+    }
+
+    void PosePredictor::update(const cv::Mat & rvec, const cv::Mat & tvec, double timestamp){
+
+        cv::Vec3d measuredT = toVec3d(tvec);
+        cv::Matx33d measuredR = expSO3(toVec3d(rvec));
+
+        double rt = translationMeasurementNoise * translationMeasurementNoise;
+        double rr = rotationMeasurementNoise * rotationMeasurementNoise;
+
+        if(!bInitialized) {
+            translation = measuredT;
+            rotation = measuredR;
+            velocity = angularVelocity = cv::Vec3d(0, 0, 0);
+            for(int i = 0; i < 3; i++) {
+                // unknown velocity at start
+                translationCov[i].pp = rt;
+                translationCov[i].pv = 0;
+                translationCov[i].vv = 1e4;
+                rotationCov[i].pp = rr;
+                rotationCov[i].pv = 0;
+                rotationCov[i].vv = 1e2;
+            }
+            lastTimestamp = timestamp;
+            bInitialized = true;
+            return;
+        }
+
+        double dt = timestamp - lastTimestamp;
+        if(dt > 0) {
+            translation += velocity * dt;
+            rotation = expSO3(angularVelocity * dt) * rotation;
+            for(int i = 0; i < 3; i++) {
+                predictAxis(translationCov[i], dt, translationProcessNoise * translationProcessNoise);
+                predictAxis(rotationCov[i], dt, rotationProcessNoise * rotationProcessNoise);
+            }
+            lastTimestamp = timestamp;
+        }
+
+        // rotation is corrected on the tangent space of the prediction, so the filter
+        // never sees the 2*pi wrap-around of rotation vectors
+        cv::Vec3d rotInnovation = logSO3(measuredR * rotation.t());
+        cv::Vec3d rotCorrection;
+
+        for(int i = 0; i < 3; i++) {
+            double dp, dv;
+            correctAxis(translationCov[i], measuredT[i] - translation[i], rt, dp, dv);
+            translation[i] += dp;
+            velocity[i] += dv;
+
+            correctAxis(rotationCov[i], rotInnovation[i], rr, dp, dv);
+            rotCorrection[i] = dp;
+            angularVelocity[i] += dv;
+        }
+        rotation = expSO3(rotCorrection) * rotation;
+    }
+
+    bool PosePredictor::predict(cv::Mat & rvec, cv::Mat & tvec) const {
+        return predictAt(lastTimestamp + latency, rvec, tvec);
+    }
+
+    bool PosePredictor::predictAt(double time, cv::Mat & rvec, cv::Mat & tvec) const {
+
+        if(!bInitialized) return false;
+
+        double dt = time - lastTimestamp;
+        cv::Vec3d t = translation + velocity * dt;
+        cv::Vec3d r = logSO3(expSO3(angularVelocity * dt) * rotation);
+
+        rvec = (cv::Mat_<double>(3, 1) << r[0], r[1], r[2]);
+        tvec = (cv::Mat_<double>(3, 1) << t[0], t[1], t[2]);
+        return true;
+    }
+}
@@ -0,0 +1,67 @@
+/*
+ * ofxCvPosePredictor.h
+ *
+ * Constant-velocity Kalman filter on object poses (rotation vector + translation)
+ * used to extrapolate tracked poses to the time the projector actually displays them.
+ */
+
+#pragma once
+
+#include "ofMain.h"
+#include "ofxCv.h"
+
+namespace ofxCv {
+
+    class PosePredictor {
+
+    public:
+        PosePredictor();
+
+        void reset();
+
+        // capture -> display latency, in seconds
+        void setLatency(double seconds) { latency = seconds; }
+        double getLatency() const { return latency; }
+
+        // acceleration noise (units/s^2 and rad/s^2) : higher values follow fast motion more closely
+        void setProcessNoise(double translation, double rotation);
+        // measurement noise std dev (units and rad) of the tracker
+        void setMeasurementNoise(double translation, double rotation);
+
+        // feed a measured object-to-camera pose captured at 'timestamp' (seconds)
+        void update(const cv::Mat & rvec, const cv::Mat & tvec, double timestamp);
+
+        // pose extrapolated to the expected display time (last capture + latency)
+        bool predict(cv::Mat & rvec, cv::Mat & tvec) const;
+        // pose extrapolated to an arbitrary time
+        bool predictAt(double time, cv::Mat & rvec, cv::Mat & tvec) const;
+
+        bool isInitialized() const { return bInitialized; }
+        double getLastTimestamp() const { return lastTimestamp; }
+
+    protected:
+
+        // per axis [position, velocity] covariance
+        struct AxisCovariance {
+            double pp, pv, vv;
+        };
+
+        void predictAxis(AxisCovariance & cov, double dt, double q) const;
+        void correctAxis(AxisCovariance & cov, double innovation, double r,
+                         double & posCorrection, double & velCorrection) const;
+
+        bool bInitialized;
+        double lastTimestamp;
+        double latency;
+
+        double translationProcessNoise, rotationProcessNoise;
+        double translationMeasurementNoise, rotationMeasurementNoise;
+
+        cv::Vec3d translation, velocity;
+        cv::Matx33d rotation;
+        cv::Vec3d angularVelocity;
+
+        AxisCovariance translationCov[3];
+        AxisCovariance rotationCov[3];
+    };
+}
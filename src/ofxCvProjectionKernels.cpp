@@ -0,0 +1,82 @@
+/*
+ * ofxCvProjectionKernels.cpp
+ *
+ * Projection, back-projection and rigid pose kernels templated on the scalar
+ * type : float for throughput (twice the SIMD width), double for accuracy,
+ * chosen per call site. The error of float against double can be measured.
+ */
+
+#include "ofxCvProjectionKernels.h"
+
+namespace ofxCv {
+
+    KernelAccuracy::KernelAccuracy()
+    :numPoints(0)
+    ,maxUndistortionError(0)
+    ,maxBackProjectionError(0)
+    ,maxProjectionError(0)
+    ,rmsProjectionError(0)
+    ,maxPoseError(0)
+    ,maxRoundTripError(0) {
+    }
+
+    void KernelAccuracy::check(const cv::Mat & cameraMatrix, const cv::Mat & cameraDistCoeffs, cv::Size cameraSize,
+                               const cv::Mat & projectorMatrix, const cv::Mat & projectorDistCoeffs,
+                               const cv::Mat & rotCamToProj, const cv::Mat & transCamToProj,
+                               const cv::Mat & boardRot, const cv::Mat & boardTrans, int gridStep){
+
+        *this = KernelAccuracy();
+
+        vector<cv::Point2f> pixels;
+        for(int y = 0; y <= cameraSize.height; y += gridStep) {
+            for(int x = 0; x <= cameraSize.width; x += gridStep) {
+                pixels.push_back(cv::Point2f(x, y));
+            }
+        }
+        numPoints = pixels.size();
+        if(numPoints == 0) return;
+
+        LensModel<double> cameraLens64(cameraMatrix, cameraDistCoeffs);
+        LensModel<float> cameraLens32(cameraMatrix, cameraDistCoeffs);
+        LensModel<double> projectorLens64(projectorMatrix, projectorDistCoeffs);
+        LensModel<float> projectorLens32(projectorMatrix, projectorDistCoeffs);
+        RigidPose<double> boardToCam64(boardRot, boardTrans);
+        RigidPose<float> boardToCam32(boardRot, boardTrans);
+        RigidPose<double> boardToProj64 = boardToCam64.then(RigidPose<double>(rotCamToProj, transCamToProj));
+        RigidPose<float> boardToProj32 = boardToCam32.then(RigidPose<float>(rotCamToProj, transCamToProj));
+
+        for(int i = 0; i < 9; i++) {
+            maxPoseError = MAX(maxPoseError, fabs(boardToProj32.r[i] - boardToProj64.r[i]));
+        }
+        for(int i = 0; i < 3; i++) {
+            maxPoseError = MAX(maxPoseError, fabs(boardToProj32.t[i] - boardToProj64.t[i]));
+        }
+
+        vector<cv::Point2f> rays64, rays32;
+        rays64.resize(numPoints);
+        rays32.resize(numPoints);
+        undistortToRays(cameraLens64, &pixels[0], &rays64[0], numPoints);
+        undistortToRays(cameraLens32, &pixels[0], &rays32[0], numPoints);
+
+        vector<cv::Point3f> board64, board32;
+        backProjectToPlane(boardToCam64, rays64, board64);
+        backProjectToPlane(boardToCam32, rays32, board32);
+
+        vector<cv::Point2f> projected64, projected32, roundTrip32;
+        projectToImage(projectorLens64, boardToProj64, board64, projected64);
+        projectToImage(projectorLens32, boardToProj32, board64, projected32);
+        projectToImage(projectorLens32, boardToProj32, board32, roundTrip32);
+
+        double squaredError = 0;
+        for(int i = 0; i < numPoints; i++) {
+            cv::Point2f dr = rays32[i] - rays64[i];
+            maxUndistortionError = MAX(maxUndistortionError, cv::norm(cv::Point2d(dr.x * cameraLens64.fx, dr.y * cameraLens64.fy)));
+            maxBackProjectionError = MAX(maxBackProjectionError, cv::norm(board32[i] - board64[i]));
+            double projectionError = cv::norm(projected32[i] - projected64[i]);
+            maxProjectionError = MAX(maxProjectionError, projectionError);
+            squaredError += projectionError * projectionError;
+            maxRoundTripError = MAX(maxRoundTripError, cv::norm(roundTrip32[i] - projected64[i]));
+        }
+        rmsProjectionError = sqrt(squaredError / numPoints);
+    }
+}
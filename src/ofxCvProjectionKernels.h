@@ -0,0 +1,192 @@
+/*
+ * ofxCvProjectionKernels.h
+ *
+ * Projection, back-projection and rigid pose kernels templated on the scalar
+ * type : float for throughput (twice the SIMD width), double for accuracy,
+ * chosen per call site. The error of float against double can be measured.
+ */
+
+#pragma once
+
+#include "ofMain.h"
+#include "ofxCv.h"
+
+namespace ofxCv {
+
+#pragma mark - LensModel
+
+    // pinhole with the k1 k2 p1 p2 k3 distortion of cv::projectPoints, the rational
+    // terms are ignored like in the bundle adjuster
+    template<typename T>
+    struct LensModel {
+        LensModel()
+        :fx(1), fy(1), cx(0), cy(0), k1(0), k2(0), p1(0), p2(0), k3(0) {
+        }
+        LensModel(const cv::Mat & cameraMatrix, const cv::Mat & distCoeffs) {
+            cv::Mat_<double> K;
+            cameraMatrix.convertTo(K, CV_64F);
+            fx = K(0, 0), fy = K(1, 1), cx = K(0, 2), cy = K(1, 2);
+            double d[5] = {0, 0, 0, 0, 0};
+            for(int i = 0; i < MIN((int) distCoeffs.total(), 5); i++) {
+                d[i] = distCoeffs.depth() == CV_32F ? distCoeffs.ptr<float>()[i] : distCoeffs.ptr<double>()[i];
+            }
+            k1 = d[0], k2 = d[1], p1 = d[2], p2 = d[3], k3 = d[4];
+        }
+
+        // normalized (x, y) with z = 1 -> pixel
+        cv::Point_<T> distort(T x, T y) const {
+            T x2 = x * x, y2 = y * y, xy = x * y;
+            T r2 = x2 + y2;
+            T radial = 1 + r2 * (k1 + r2 * (k2 + r2 * k3));
+            T xd = x * radial + 2 * p1 * xy + p2 * (r2 + 2 * x2);
+            T yd = y * radial + p1 * (r2 + 2 * y2) + 2 * p2 * xy;
+            return cv::Point_<T>(fx * xd + cx, fy * yd + cy);
+        }
+        // pixel -> normalized, same fixed point iteration as cv::undistortPoints
+        cv::Point_<T> undistort(T u, T v, int iterations = 5) const {
+            T x0 = (u - cx) / fx, y0 = (v - cy) / fy;
+            T x = x0, y = y0;
+            for(int i = 0; i < iterations; i++) {
+                T x2 = x * x, y2 = y * y, xy = x * y;
+                T r2 = x2 + y2;
+                T icdist = 1 / (1 + r2 * (k1 + r2 * (k2 + r2 * k3)));
+                T dx = 2 * p1 * xy + p2 * (r2 + 2 * x2);
+                T dy = p1 * (r2 + 2 * y2) + 2 * p2 * xy;
+                x = (x0 - dx) * icdist;
+                y = (y0 - dy) * icdist;
+            }
+            return cv::Point_<T>(x, y);
+        }
+
+        T fx, fy, cx, cy;
+        T k1, k2, p1, p2, k3;
+    };
+
+#pragma mark - RigidPose
+
+    // X' = R X + t
+    template<typename T>
+    struct RigidPose {
+        RigidPose() {
+            for(int i = 0; i < 9; i++) r[i] = (i % 4 == 0);
+            t[0] = t[1] = t[2] = 0;
+        }
+        // Rodrigues rotation vector & translation, as returned by solvePnP
+        RigidPose(const cv::Mat & rvec, const cv::Mat & tvec) {
+            cv::Mat rvec64, tvec64;
+            rvec.convertTo(rvec64, CV_64F);
+            tvec.convertTo(tvec64, CV_64F);
+            cv::Matx33d rotation;
+            cv::Rodrigues(rvec64.reshape(1, 3), rotation);
+            for(int i = 0; i < 9; i++) r[i] = rotation.val[i];
+            for(int i = 0; i < 3; i++) t[i] = tvec64.ptr<double>()[i];
+        }
+
+        cv::Point3_<T> apply(T x, T y, T z) const {
+            return cv::Point3_<T>(r[0] * x + r[1] * y + r[2] * z + t[0],
+                                  r[3] * x + r[4] * y + r[5] * z + t[1],
+                                  r[6] * x + r[7] * y + r[8] * z + t[2]);
+        }
+        RigidPose inverse() const {
+            RigidPose inv;
+            for(int i = 0; i < 3; i++) {
+                for(int j = 0; j < 3; j++) inv.r[3 * i + j] = r[3 * j + i];
+            }
+            for(int i = 0; i < 3; i++) {
+                inv.t[i] = -(inv.r[3 * i] * t[0] + inv.r[3 * i + 1] * t[1] + inv.r[3 * i + 2] * t[2]);
+            }
+            return inv;
+        }
+        // this pose followed by next, like cv::composeRT(this, next)
+        RigidPose then(const RigidPose & next) const {
+            RigidPose composed;
+            for(int i = 0; i < 3; i++) {
+                for(int j = 0; j < 3; j++) {
+                    composed.r[3 * i + j] = next.r[3 * i] * r[j] + next.r[3 * i + 1] * r[3 + j] + next.r[3 * i + 2] * r[6 + j];
+                }
+                composed.t[i] = next.r[3 * i] * t[0] + next.r[3 * i + 1] * t[1] + next.r[3 * i + 2] * t[2] + next.t[i];
+            }
+            return composed;
+        }
+
+        T r[9], t[3];
+    };
+
+#pragma mark - kernels
+
+    // object points -> pixels, like cv::projectPoints
+    template<typename T>
+    void projectToImage(const LensModel<T> & lens, const RigidPose<T> & pose,
+                        const cv::Point3f * pts, cv::Point2f * out, int count) {
+        for(int i = 0; i < count; i++) {
+            cv::Point3_<T> p = pose.apply(pts[i].x, pts[i].y, pts[i].z);
+            T iz = 1 / p.z;
+            cv::Point_<T> pixel = lens.distort(p.x * iz, p.y * iz);
+            out[i] = cv::Point2f(pixel.x, pixel.y);
+        }
+    }
+
+    template<typename T>
+    void projectToImage(const LensModel<T> & lens, const RigidPose<T> & pose,
+                        const vector<cv::Point3f> & pts, vector<cv::Point2f> & out) {
+        out.resize(pts.size());
+        if(!pts.empty()) projectToImage(lens, pose, &pts[0], &out[0], pts.size());
+    }
+
+    // pixels -> normalized rays, like cv::undistortPoints without P
+    template<typename T>
+    void undistortToRays(const LensModel<T> & lens, const cv::Point2f * pts, cv::Point2f * out, int count) {
+        for(int i = 0; i < count; i++) {
+            cv::Point_<T> ray = lens.undistort(pts[i].x, pts[i].y);
+            out[i] = cv::Point2f(ray.x, ray.y);
+        }
+    }
+
+    // normalized camera rays -> points on the z = 0 plane of a board, with
+    // boardToCam the board pose in the camera frame
+    template<typename T>
+    void backProjectToPlane(const RigidPose<T> & boardToCam, const cv::Point2f * rays, cv::Point3f * out, int count) {
+        RigidPose<T> camToBoard = boardToCam.inverse();
+        const T * r = camToBoard.r;
+        const T * t = camToBoard.t;
+        for(int i = 0; i < count; i++) {
+            // the camera center is t in the board frame, the ray direction R (x, y, 1)
+            T dx = r[0] * rays[i].x + r[1] * rays[i].y + r[2];
+            T dy = r[3] * rays[i].x + r[4] * rays[i].y + r[5];
+            T dz = r[6] * rays[i].x + r[7] * rays[i].y + r[8];
+            T s = -t[2] / dz;
+            out[i] = cv::Point3f(t[0] + s * dx, t[1] + s * dy, 0);
+        }
+    }
+
+    template<typename T>
+    void backProjectToPlane(const RigidPose<T> & boardToCam, const vector<cv::Point2f> & rays, vector<cv::Point3f> & out) {
+        out.resize(rays.size());
+        if(!rays.empty()) backProjectToPlane(boardToCam, &rays[0], &out[0], rays.size());
+    }
+
+#pragma mark - KernelAccuracy
+
+    // float kernels against the double reference over a grid of camera pixels, sent
+    // to a board plane then into the projector
+    struct KernelAccuracy {
+        KernelAccuracy();
+
+        void check(const cv::Mat & cameraMatrix, const cv::Mat & cameraDistCoeffs, cv::Size cameraSize,
+                   const cv::Mat & projectorMatrix, const cv::Mat & projectorDistCoeffs,
+                   const cv::Mat & rotCamToProj, const cv::Mat & transCamToProj,
+                   const cv::Mat & boardRot, const cv::Mat & boardTrans, int gridStep = 16);
+
+        int numPoints;
+        // camera undistortion, in camera pixels
+        double maxUndistortionError;
+        // on the board, in board units
+        double maxBackProjectionError;
+        // board -> projector, from the same board points, in projector pixels
+        double maxProjectionError, rmsProjectionError;
+        // composed rotation & translation of the board -> projector pose
+        double maxPoseError;
+        // camera pixel -> board -> projector pixel
+        double maxRoundTripError;
+    };
+}
@@ -0,0 +1,274 @@
+/*
+ * ofxCvProjectorLatency.cpp
+ *
+ * Measures the projector -> camera round trip by flashing a pseudo-random code
+ * and correlating it with the camera brightness, and schedules captures so that
+ * a camera frame is only used once it shows the latest projected pattern.
+ */
+
+#include "ofxCvProjectorLatency.h"
+
+namespace ofxCv {
+
+    namespace {
+        bool compareTime(double t, const pair<double, int> & e) {
+            return t < e.first;
+        }
+    }
+
+#pragma mark - LatencyEstimator
+
+    LatencyEstimator::LatencyEstimator()
+    :bMeasuring(false)
+    ,bDone(false)
+    ,displayedFrames(0)
+    ,latency(0)
+    ,confidence(0) {
+        setup();
+    }
+
+    void LatencyEstimator::setup(int codeLength, int holdFrames, double maxLatency){
+        this->holdFrames = MAX(1, holdFrames);
+        this->maxLatency = maxLatency;
+        resolution = 0.001;
+
+        // fixed xorshift sequence so the code has a single sharp correlation peak,
+        // framed by a 0 -> 1 edge at the start
+        code.clear();
+        code.push_back(0);
+        code.push_back(1);
+        unsigned int x = 2463534242u;
+        while(code.size() < (size_t) MAX(codeLength, 4)) {
+            x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+            code.push_back(x & 1);
+        }
+    }
+
+    void LatencyEstimator::start(){
+        displayEvents.clear();
+        cameraSamples.clear();
+        displayedFrames = 0;
+        bMeasuring = true;
+        bDone = false;
+        latency = 0;
+        confidence = 0;
+    }
+
+    unsigned char LatencyEstimator::nextFlash(double displayTime){
+        if(!bMeasuring) return 0;
+
+        // the projector stays dark after the code, which also closes its last edge
+        int bitIndex = displayedFrames / holdFrames;
+        int bit = bitIndex < (int) code.size() ? code[bitIndex] : 0;
+        if(displayEvents.empty() || displayEvents.back().second != bit) {
+            displayEvents.push_back(make_pair(displayTime, bit));
+        }
+        if(bitIndex < (int) code.size()) displayedFrames++;
+        return bit ? 255 : 0;
+    }
+
+    void LatencyEstimator::addCameraFrame(const cv::Mat & img, double captureTime){
+        if(!bMeasuring) return;
+
+        cameraSamples.push_back(make_pair(captureTime, (float) cv::mean(img)[0]));
+
+        bool bCodeDisplayed = displayedFrames >= (int) code.size() * holdFrames;
+        if(bCodeDisplayed && captureTime > displayEvents.back().first + maxLatency) {
+            estimate();
+            bMeasuring = false;
+            bDone = true;
+        }
+    }
+
+    int LatencyEstimator::getDisplayedBit(double time) const {
+        vector<pair<double, int> >::const_iterator it;
+        it = upper_bound(displayEvents.begin(), displayEvents.end(), time, compareTime);
+        if(it == displayEvents.begin()) return -1;
+        return (it - 1)->second;
+    }
+
+    void LatencyEstimator::estimate(){
+
+        if(cameraSamples.empty() || displayEvents.empty()) return;
+
+        float minLevel = cameraSamples[0].second, maxLevel = minLevel;
+        for(size_t i = 0; i < cameraSamples.size(); i++) {
+            minLevel = MIN(minLevel, cameraSamples[i].second);
+            maxLevel = MAX(maxLevel, cameraSamples[i].second);
+        }
+        float threshold = (minLevel + maxLevel) * 0.5f;
+
+        int numLags = maxLatency / resolution + 1;
+        vector<float> scores(numLags, 0);
+        for(int l = 0; l < numLags; l++) {
+            double lag = l * resolution;
+            int agree = 0, total = 0;
+            for(size_t i = 0; i < cameraSamples.size(); i++) {
+                int bit = getDisplayedBit(cameraSamples[i].first - lag);
+                if(bit < 0) continue;
+                total++;
+                if(bit == (cameraSamples[i].second > threshold)) agree++;
+            }
+            scores[l] = total > 0 ? float(agree) / total : 0;
+        }
+
+        // the best lags form a plateau one camera frame wide, its center is the estimate
+        int bestStart = max_element(scores.begin(), scores.end()) - scores.begin();
+        int bestEnd = bestStart;
+        while(bestEnd + 1 < numLags && scores[bestEnd + 1] == scores[bestStart]) bestEnd++;
+
+        latency = (bestStart + bestEnd) * 0.5 * resolution;
+        confidence = scores[bestStart];
+    }
+
+#pragma mark - CaptureScheduler
+
+    CaptureScheduler::CaptureScheduler()
+    :state(IDLE)
+    ,latency(1. / 30.)
+    ,settleTime(0)
+    ,displayTime(0) {
+    }
+
+    void CaptureScheduler::patternChanged(){
+        state = CHANGED;
+    }
+
+    void CaptureScheduler::patternDisplayed(double time){
+        if(state == CHANGED) {
+            displayTime = time;
+            state = DISPLAYED;
+        }
+    }
+
+    bool CaptureScheduler::isFrameCurrent(double captureTime) const {
+        return state == DISPLAYED && captureTime >= displayTime + latency + settleTime;
+    }
+
+    void CaptureScheduler::consume(){
+        state = IDLE;
+    }
+
+#pragma mark - SimulatedProjectorCamera
+
+    SimulatedProjectorCamera::SimulatedProjectorCamera()
+    :displayDelay(0.1)
+    ,captureDelay(0)
+    ,noise(0) {
+    }
+
+    void SimulatedProjectorCamera::display(const cv::Mat & frame, double time){
+        frames.push_back(make_pair(time, frame.clone()));
+    }
+
+    bool SimulatedProjectorCamera::capture(double time, cv::Mat & out){
+        double visibleTime = time - displayDelay - captureDelay;
+
+        // drop frames that have been replaced by a newer visible one
+        while(frames.size() > 1 && frames[1].first <= visibleTime) {
+            frames.pop_front();
+        }
+        if(frames.empty() || frames.front().first > visibleTime) {
+            return false;
+        }
+        frames.front().second.copyTo(out);
+        if(noise > 0) {
+            cv::Mat n(out.size(), CV_32FC(out.channels()));
+            cv::randn(n, 0, noise);
+            cv::Mat noisy;
+            out.convertTo(noisy, CV_32F);
+            noisy += n;
+            noisy.convertTo(out, frames.front().second.type());
+        }
+        return true;
+    }
+
+#pragma mark - LatencyCheck
+
+    LatencyCheck::LatencyCheck()
+    :displayRate(60)
+    ,cameraRate(30)
+    ,noise(2)
+    ,estimatedLatency(0) {
+    }
+
+    void LatencyCheck::setRates(double displayRate, double cameraRate){
+        this->displayRate = displayRate;
+        this->cameraRate = cameraRate;
+    }
+
+    bool LatencyCheck::run(double displayDelay, double captureDelay, double tolerance){
+
+        SimulatedProjectorCamera simulation;
+        simulation.setDelays(displayDelay, captureDelay);
+        simulation.setNoise(noise);
+        double latency = simulation.getLatency();
+
+        LatencyEstimator estimator;
+        estimator.setup(24, 3, MAX(0.5, 2 * latency));
+        estimator.start();
+
+        // the camera isn't synchronized with the display
+        double cameraPhase = 0.37 / displayRate;
+        cv::Mat frame(4, 4, CV_8UC1), captured;
+        int displayFrame = 0, cameraFrame = 0;
+        double endTime = 30;
+        while(!estimator.isDone()) {
+            double displayTime = displayFrame / displayRate;
+            double captureTime = cameraFrame / cameraRate + cameraPhase;
+            if(displayTime > endTime) break;
+            if(displayTime <= captureTime) {
+                frame = cv::Scalar(estimator.nextFlash(displayTime));
+                simulation.display(frame, displayTime);
+                displayFrame++;
+            } else {
+                if(simulation.capture(captureTime, captured)) {
+                    estimator.addCameraFrame(captured, captureTime);
+                }
+                cameraFrame++;
+            }
+        }
+        estimatedLatency = estimator.getLatency();
+        bool bEstimated = estimator.isDone() && fabs(estimatedLatency - latency) <= tolerance;
+
+        // patterns of increasing gray levels, the scheduler must only accept frames showing the current one
+        CaptureScheduler scheduler;
+        scheduler.setLatency(estimatedLatency);
+        scheduler.setSettleTime(tolerance);
+        int pattern = 0, numPatterns = 20, staleFrames = 0;
+        double startTime = displayFrame / displayRate;
+        endTime = startTime + 30;
+        scheduler.patternChanged();
+        while(pattern < numPatterns) {
+            double displayTime = displayFrame / displayRate;
+            double captureTime = cameraFrame / cameraRate + cameraPhase;
+            if(displayTime > endTime) break;
+            if(displayTime <= captureTime) {
+                frame = cv::Scalar(10 * (pattern + 1));
+                simulation.display(frame, displayTime);
+                scheduler.patternDisplayed(displayTime);
+                displayFrame++;
+            } else {
+                if(simulation.capture(captureTime, captured) && scheduler.isFrameCurrent(captureTime)) {
+                    // the noise stays well below the steps between patterns
+                    if(fabs(cv::mean(captured)[0] - 10 * (pattern + 1)) > 5) staleFrames++;
+                    scheduler.consume();
+                    pattern++;
+                    scheduler.patternChanged();
+                }
+                cameraFrame++;
+            }
+        }
+        bool bScheduled = pattern == numPatterns && staleFrames == 0;
+
+        stringstream out;
+        out << (bEstimated ? "ok     " : "FAILED ") << "latency : estimated " << estimatedLatency
+            << "s for " << latency << "s (display " << displayDelay << "s + capture " << captureDelay
+            << "s), confidence " << estimator.getConfidence() << ", tolerance " << tolerance << "s\n";
+        out << (bScheduled ? "ok     " : "FAILED ") << "capture scheduling : " << pattern << "/" << numPatterns
+            << " patterns captured, " << staleFrames << " stale frames\n";
+        report = out.str();
+
+        return bEstimated && bScheduled;
+    }
+}
@@ -0,0 +1,139 @@
+/*
+ * ofxCvProjectorLatency.h
+ *
+ * Measures the projector -> camera round trip by flashing a pseudo-random code
+ * and correlating it with the camera brightness, and schedules captures so that
+ * a camera frame is only used once it shows the latest projected pattern.
+ */
+
+#pragma once
+
+#include "ofMain.h"
+#include "ofxCv.h"
+
+namespace ofxCv {
+
+#pragma mark - LatencyEstimator
+
+    class LatencyEstimator {
+
+    public:
+        LatencyEstimator();
+
+        // codeLength bits, each one shown for holdFrames consecutive display frames
+        void setup(int codeLength = 24, int holdFrames = 3, double maxLatency = 0.5);
+        void start();
+
+        // call once per projector frame with the time it is displayed,
+        // returns the gray level to fill the projector with
+        unsigned char nextFlash(double displayTime);
+        // call with every camera frame seeing the projection (or a crop of it)
+        void addCameraFrame(const cv::Mat & img, double captureTime);
+
+        bool isMeasuring() const { return bMeasuring; }
+        bool isDone() const { return bDone; }
+
+        // round trip in seconds, and fraction of camera samples agreeing with the code
+        double getLatency() const { return latency; }
+        float getConfidence() const { return confidence; }
+
+    protected:
+        void estimate();
+        int getDisplayedBit(double time) const;
+
+        int holdFrames;
+        double maxLatency;
+        double resolution;
+        vector<unsigned char> code;
+
+        bool bMeasuring, bDone;
+        int displayedFrames;
+        vector<pair<double, int> > displayEvents;
+        vector<pair<double, float> > cameraSamples;
+
+        double latency;
+        float confidence;
+    };
+
+#pragma mark - CaptureScheduler
+
+    class CaptureScheduler {
+
+    public:
+        CaptureScheduler();
+
+        void setLatency(double seconds) { latency = seconds; }
+        double getLatency() const { return latency; }
+        // extra time so the camera exposure fully covers the new pattern
+        void setSettleTime(double seconds) { settleTime = seconds; }
+
+        // the projected pattern (e.g. getCandidateImagePoints) has been modified
+        void patternChanged();
+        // called by the renderer when the modified pattern is first drawn
+        void patternDisplayed(double displayTime);
+        // true when a frame captured at captureTime reflects the current pattern
+        bool isFrameCurrent(double captureTime) const;
+        // the current pattern has been used, a new one can be computed
+        void consume();
+
+        bool isIdle() const { return state == IDLE; }
+        bool isWaitingForDisplay() const { return state == CHANGED; }
+
+    protected:
+        enum State { IDLE, CHANGED, DISPLAYED };
+        State state;
+        double latency, settleTime;
+        double displayTime;
+    };
+
+#pragma mark - SimulatedProjectorCamera
+
+    // delayed display / camera pair to exercise the two classes above without hardware
+    class SimulatedProjectorCamera {
+
+    public:
+        SimulatedProjectorCamera();
+
+        // whole round trip, as display delay only
+        void setLatency(double seconds) { setDelays(seconds, 0); }
+        // from the render call to the light, and from the light to the timestamped frame
+        void setDelays(double display, double capture) { displayDelay = display, captureDelay = capture; }
+        double getLatency() const { return displayDelay + captureDelay; }
+        void setNoise(float sigma) { noise = sigma; }
+
+        void display(const cv::Mat & frame, double time);
+        // what the camera sees at 'time' : the last frame displayed before time - latency
+        bool capture(double time, cv::Mat & out);
+
+    protected:
+        double displayDelay, captureDelay;
+        float noise;
+        deque<pair<double, cv::Mat> > frames;
+    };
+
+#pragma mark - LatencyCheck
+
+    // runs LatencyEstimator then CaptureScheduler against a simulated pair with
+    // known delays, e.g. from a CI job
+    class LatencyCheck {
+
+    public:
+        LatencyCheck();
+
+        void setRates(double displayRate, double cameraRate);
+        void setNoise(float sigma) { noise = sigma; }
+
+        // true if the estimate is within tolerance of displayDelay + captureDelay and the
+        // scheduler never lets through a frame showing an older pattern
+        bool run(double displayDelay, double captureDelay, double tolerance = 0.01);
+
+        double getEstimatedLatency() const { return estimatedLatency; }
+        const string & getReport() const { return report; }
+
+    protected:
+        double displayRate, cameraRate;
+        float noise;
+        double estimatedLatency;
+        string report;
+    };
+}
@@ -0,0 +1,195 @@
+/*
+ * ofxCvProjectorMatrices.cpp
+ *
+ * OpenGL projection & modelview matrices of the projector, derived from its
+ * intrinsics and the camera -> projector extrinsics, cached as column-major
+ * float arrays and only recomputed when the calibration or the pose changes.
+ */
+
+#include "ofxCvProjectorMatrices.h"
+
+namespace ofxCv {
+
+    namespace {
+        template<int n>
+        void setKey(cv::Vec<double, n> & key, int offset, const cv::Mat & m, int count) {
+            cv::Mat m64;
+            m.convertTo(m64, CV_64F);
+            for(int i = 0; i < MIN((int) m64.total(), count); i++) {
+                key[offset + i] = m64.ptr<double>()[i];
+            }
+        }
+    }
+
+    ProjectorMatrices::ProjectorMatrices()
+    :nearDist(1)
+    ,farDist(10000)
+    ,snapshot(NULL)
+    ,snapshotVersion(0)
+    ,maxDistortionError(0) {
+        // nothing cached yet, NaN never compares equal
+        calibrationKey = cv::Vec<double, 17>::all(std::numeric_limits<double>::quiet_NaN());
+        poseKey = cv::Vec<double, 6>::all(std::numeric_limits<double>::quiet_NaN());
+        for(int i = 0; i < 16; i++) {
+            projection[i] = modelView[i] = (i % 5 == 0);
+        }
+    }
+
+    void ProjectorMatrices::setClipPlanes(float nearDist, float farDist){
+        if(nearDist == this->nearDist && farDist == this->farDist) return;
+        this->nearDist = nearDist;
+        this->farDist = farDist;
+        updateProjection();
+    }
+
+    bool ProjectorMatrices::setCalibration(const cv::Mat & projectorMatrix, const cv::Mat & projectorDistCoeffs, cv::Size projectorSize,
+                                           const cv::Mat & rotCamToProj, const cv::Mat & transCamToProj){
+        snapshot = NULL;
+        if(rotCamToProj.empty() || transCamToProj.empty()) return false;
+
+        // [fx fy cx cy | k1 k2 p1 p2 k3 | width height | rot | trans]
+        cv::Mat_<double> K;
+        projectorMatrix.convertTo(K, CV_64F);
+        cv::Vec<double, 17> key = cv::Vec<double, 17>::all(0);
+        key[0] = K(0, 0), key[1] = K(1, 1), key[2] = K(0, 2), key[3] = K(1, 2);
+        setKey(key, 4, projectorDistCoeffs, 5);
+        key[9] = projectorSize.width;
+        key[10] = projectorSize.height;
+        setKey(key, 11, rotCamToProj, 3);
+        setKey(key, 14, transCamToProj, 3);
+        if(key == calibrationKey) return false;
+        calibrationKey = key;
+
+        this->projectorSize = projectorSize;
+        lens = LensModel<double>(projectorMatrix, projectorDistCoeffs);
+        camToProj = RigidPose<double>(rotCamToProj, transCamToProj);
+        updateProjection();
+        updateModelView();
+        return true;
+    }
+
+    bool ProjectorMatrices::setCalibration(const CalibrationSnapshot & calibration){
+        // snapshots are immutable, version 0 isn't numbered by a store though
+        unsigned long version = calibration.getVersion();
+        if(version != 0 && snapshot == &calibration && snapshotVersion == version) return false;
+
+        bool bChanged = setCalibration(calibration.getProjectorIntrinsics().getCameraMatrix(),
+                                       calibration.getProjectorDistCoeffs(),
+                                       calibration.getProjectorIntrinsics().getImageSize(),
+                                       calibration.getCamToProjRotation(),
+                                       calibration.getCamToProjTranslation());
+        if(version != 0) {
+            snapshot = &calibration;
+            snapshotVersion = version;
+        }
+        return bChanged;
+    }
+
+    bool ProjectorMatrices::setCalibration(const CameraProjectorCalibration & calibration){
+        const ProjectorCalibration & calibrationProjector = calibration.getCalibrationProjector();
+        return setCalibration(calibrationProjector.getDistortedIntrinsics().getCameraMatrix(),
+                              calibrationProjector.getDistCoeffs(),
+                              calibrationProjector.getDistortedIntrinsics().getImageSize(),
+                              calibration.getCamToProjRotation(),
+                              calibration.getCamToProjTranslation());
+    }
+
+    bool ProjectorMatrices::setObjectPose(const cv::Mat & rotObjToCam, const cv::Mat & transObjToCam){
+        if(rotObjToCam.empty() || transObjToCam.empty()) return false;
+
+        cv::Vec<double, 6> key;
+        setKey(key, 0, rotObjToCam, 3);
+        setKey(key, 3, transObjToCam, 3);
+        if(key == poseKey) return false;
+        poseKey = key;
+
+        objToCam = RigidPose<double>(rotObjToCam, transObjToCam);
+        updateModelView();
+        return true;
+    }
+
+    void ProjectorMatrices::updateProjection(){
+        // glFrustum with the principal point off center, same as Intrinsics::loadProjectionMatrix :
+        // top & bottom are swapped since openFrameworks flips every loaded projection vertically
+        double w = projectorSize.width, h = projectorSize.height;
+        double n = nearDist, f = farDist;
+        double left = n * -lens.cx / lens.fx;
+        double right = n * (w - lens.cx) / lens.fx;
+        double bottom = n * lens.cy / lens.fy;
+        double top = n * (lens.cy - h) / lens.fy;
+
+        for(int i = 0; i < 16; i++) projection[i] = 0;
+        projection[0] = 2 * n / (right - left);
+        projection[5] = 2 * n / (top - bottom);
+        projection[8] = (right + left) / (right - left);
+        projection[9] = (top + bottom) / (top - bottom);
+        projection[10] = -(f + n) / (f - n);
+        projection[11] = -1;
+        projection[14] = -2 * f * n / (f - n);
+
+        // distorted vs linear projection of the image border pixels
+        maxDistortionError = 0;
+        for(int i = 0; i <= 64; i++) {
+            double s = i / 64.;
+            cv::Point2d border[4] = {
+                cv::Point2d(s * w, 0), cv::Point2d(s * w, h),
+                cv::Point2d(0, s * h), cv::Point2d(w, s * h)
+            };
+            for(int j = 0; j < 4; j++) {
+                cv::Point2d ray = lens.undistort(border[j].x, border[j].y);
+                cv::Point2d linear(lens.fx * ray.x + lens.cx, lens.fy * ray.y + lens.cy);
+                maxDistortionError = MAX(maxDistortionError, cv::norm(linear - border[j]));
+            }
+        }
+    }
+
+    void ProjectorMatrices::updateModelView(){
+        RigidPose<double> objToProj = objToCam.then(camToProj);
+        // OpenCV looks down +z with y down, GL down -z with y up : diag(1, -1, -1) * [R | t]
+        const double flip[3] = {1, -1, -1};
+        for(int row = 0; row < 3; row++) {
+            for(int col = 0; col < 3; col++) {
+                modelView[col * 4 + row] = flip[row] * objToProj.r[row * 3 + col];
+            }
+            modelView[12 + row] = flip[row] * objToProj.t[row];
+            modelView[row * 4 + 3] = 0;
+        }
+        modelView[15] = 1;
+    }
+
+    void ProjectorMatrices::begin(cv::Point2d viewportOffset) const {
+        ofPushView();
+        ofViewport(viewportOffset.x, viewportOffset.y, projectorSize.width, projectorSize.height);
+        ofSetMatrixMode(OF_MATRIX_PROJECTION);
+        ofLoadMatrix(projection);
+        ofSetMatrixMode(OF_MATRIX_MODELVIEW);
+        ofLoadMatrix(modelView);
+    }
+
+    void ProjectorMatrices::end() const {
+        ofPopView();
+    }
+
+    cv::Point2f ProjectorMatrices::transform(const cv::Point3f & pt) const {
+        const float * p = projection;
+        const float * m = modelView;
+        // eye = modelView * pt, clip = projection * eye
+        float ex = m[0] * pt.x + m[4] * pt.y + m[8] * pt.z + m[12];
+        float ey = m[1] * pt.x + m[5] * pt.y + m[9] * pt.z + m[13];
+        float ez = m[2] * pt.x + m[6] * pt.y + m[10] * pt.z + m[14];
+        float cx = p[0] * ex + p[8] * ez;
+        float cy = p[5] * ey + p[9] * ez;
+        float cw = -ez;
+        // viewport flipped by openFrameworks : ndc y -1 is the top row of the projector
+        float ndcX = cx / cw, ndcY = cy / cw;
+        return cv::Point2f((ndcX + 1) * .5f * projectorSize.width,
+                           (ndcY + 1) * .5f * projectorSize.height);
+    }
+
+    void ProjectorMatrices::transform(const vector<cv::Point3f> & pts, vector<cv::Point2f> & out) const {
+        out.resize(pts.size());
+        for(size_t i = 0; i < pts.size(); i++) {
+            out[i] = transform(pts[i]);
+        }
+    }
+}
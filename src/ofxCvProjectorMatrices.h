@@ -0,0 +1,72 @@
+/*
+ * ofxCvProjectorMatrices.h
+ *
+ * OpenGL projection & modelview matrices of the projector, derived from its
+ * intrinsics and the camera -> projector extrinsics, cached as column-major
+ * float arrays and only recomputed when the calibration or the pose changes.
+ */
+
+#pragma once
+
+#include "ofMain.h"
+#include "ofxCv.h"
+#include "ofxCvCalibrationSnapshot.h"
+
+namespace ofxCv {
+
+    class ProjectorMatrices {
+
+    public:
+        ProjectorMatrices();
+
+        void setClipPlanes(float nearDist, float farDist);
+
+        // return true when the matrices were recomputed
+        bool setCalibration(const cv::Mat & projectorMatrix, const cv::Mat & projectorDistCoeffs, cv::Size projectorSize,
+                            const cv::Mat & rotCamToProj, const cv::Mat & transCamToProj);
+        // returns early, without any conversion, for the snapshot already set (same
+        // object & version), so it can be called every frame
+        bool setCalibration(const CalibrationSnapshot & calibration);
+        bool setCalibration(const CameraProjectorCalibration & calibration);
+        // object -> camera
+        bool setObjectPose(const cv::Mat & rotObjToCam, const cv::Mat & transObjToCam);
+
+        // column-major, ready for glLoadMatrixf / ofLoadMatrix
+        const float * getProjectionMatrix() const { return projection; }
+        const float * getModelViewMatrix() const { return modelView; }
+        cv::Size getViewportSize() const { return projectorSize; }
+
+        // pushes the view and loads the viewport & both matrices, end() restores them
+        void begin(cv::Point2d viewportOffset = cv::Point2d(0, 0)) const;
+        void end() const;
+
+        // what the GL pipeline does to a vertex : object point -> projector pixel, for
+        // checking the matrices without a GL context
+        cv::Point2f transform(const cv::Point3f & pt) const;
+        void transform(const vector<cv::Point3f> & pts, vector<cv::Point2f> & out) const;
+
+        // lens distortion can't be expressed by a matrix : largest offset, in projector
+        // pixels, between the matrix projection and the distorted one over the image
+        float getMaxDistortionError() const { return maxDistortionError; }
+
+    protected:
+        void updateProjection();
+        void updateModelView();
+
+        float nearDist, farDist;
+        cv::Size projectorSize;
+        LensModel<double> lens;
+        RigidPose<double> camToProj, objToCam;
+
+        // inputs of the cached matrices
+        cv::Vec<double, 17> calibrationKey;
+        cv::Vec<double, 6> poseKey;
+        // numbered snapshot the calibration comes from, NULL otherwise
+        const CalibrationSnapshot * snapshot;
+        unsigned long snapshotVersion;
+
+        float projection[16];
+        float modelView[16];
+        float maxDistortionError;
+    };
+}
@@ -0,0 +1,108 @@
+/*
+ * ofxCvTriangulator.cpp
+ *
+ * Triangulates camera <-> projector correspondences (e.g. decoded from a
+ * structured light scan) into 3D points in the camera frame, with the midpoint
+ * method. Points are processed in chunks across a worker pool.
+ */
+
+#include "ofxCvTriangulator.h"
+
+namespace ofxCv {
+
+    Triangulator::Triangulator()
+    :bUndistortionMaps(true)
+    ,chunkSize(4096) {
+    }
+
+    void Triangulator::setup(const CameraProjectorCalibration & calibration, int numThreads, int undistortionGridStep){
+        const CameraCalibration & calibrationCamera = calibration.getCalibrationCamera();
+        const ProjectorCalibration & calibrationProjector = calibration.getCalibrationProjector();
+        cameraMatrix = calibrationCamera.getDistortedIntrinsics().getCameraMatrix().clone();
+        cameraDistCoeffs = calibrationCamera.getDistCoeffs().clone();
+        projectorMatrix = calibrationProjector.getDistortedIntrinsics().getCameraMatrix().clone();
+        projectorDistCoeffs = calibrationProjector.getDistCoeffs().clone();
+
+        // X_proj = R X_cam + t, so the projector center is -R^t t in the camera frame
+        cv::Matx33d rotCamToProj;
+        cv::Rodrigues(calibration.getCamToProjRotation(), rotCamToProj);
+        cv::Mat_<double> trans = calibration.getCamToProjTranslation();
+        rotProjToCam = rotCamToProj.t();
+        projectorCenter = -(rotProjToCam * cv::Vec3d(trans(0), trans(1), trans(2)));
+
+        bUndistortionMaps = undistortionGridStep > 0;
+        if(bUndistortionMaps) {
+            cameraUndistortion.setup(cameraMatrix, cameraDistCoeffs,
+                                     calibrationCamera.getDistortedIntrinsics().getImageSize(), undistortionGridStep);
+            projectorUndistortion.setup(projectorMatrix, projectorDistCoeffs,
+                                        calibrationProjector.getDistortedIntrinsics().getImageSize(), undistortionGridStep);
+        }
+
+        workers.setup(numThreads);
+    }
+
+    void Triangulator::triangulate(const vector<cv::Point2f> & camPts, const vector<cv::Point2f> & projPts,
+                                   vector<cv::Point3f> & points, vector<float> & residuals){
+
+        int numPoints = MIN(camPts.size(), projPts.size());
+        points.resize(numPoints);
+        residuals.resize(numPoints);
+        camRays.resize(numPoints);
+        projRays.resize(numPoints);
+        if(numPoints == 0) return;
+
+        int numChunks = (numPoints + chunkSize - 1) / chunkSize;
+        workers.parallelFor(numChunks, [&](int chunk) {
+            int start = chunk * chunkSize;
+            int count = MIN(chunkSize, numPoints - start);
+            triangulateChunk(start, count, &camPts[start], &projPts[start], &points[start], &residuals[start]);
+        });
+    }
+
+    void Triangulator::triangulateChunk(int start, int count,
+                                        const cv::Point2f * camPts, const cv::Point2f * projPts,
+                                        cv::Point3f * points, float * residuals){
+
+        if(bUndistortionMaps) {
+            cameraUndistortion.undistort(camPts, &camRays[start], count);
+            projectorUndistortion.undistort(projPts, &projRays[start], count);
+        } else {
+            // headers over the preallocated buffers, undistortPoints writes in place
+            cv::Mat camRaysMat(count, 1, CV_32FC2, &camRays[start]);
+            cv::Mat projRaysMat(count, 1, CV_32FC2, &projRays[start]);
+            cv::undistortPoints(cv::Mat(count, 1, CV_32FC2, (void *) camPts), camRaysMat, cameraMatrix, cameraDistCoeffs);
+            cv::undistortPoints(cv::Mat(count, 1, CV_32FC2, (void *) projPts), projRaysMat, projectorMatrix, projectorDistCoeffs);
+        }
+
+        const float infinity = std::numeric_limits<float>::infinity();
+
+        for(int i = 0; i < count; i++) {
+            const cv::Point2f & c = camRays[start + i];
+            const cv::Point2f & p = projRays[start + i];
+            cv::Vec3d camDir(c.x, c.y, 1);
+            cv::Vec3d projDir = rotProjToCam * cv::Vec3d(p.x, p.y, 1);
+
+            // closest points camDir * s and projectorCenter + projDir * u
+            cv::Vec3d w = -projectorCenter;
+            double a = camDir.dot(camDir);
+            double b = camDir.dot(projDir);
+            double cc = projDir.dot(projDir);
+            double d = camDir.dot(w);
+            double e = projDir.dot(w);
+            double denom = a * cc - b * b;
+            if(denom < 1e-12) {
+                points[i] = cv::Point3f(0, 0, 0);
+                residuals[i] = infinity;
+                continue;
+            }
+            double s = (b * e - cc * d) / denom;
+            double u = (a * e - b * d) / denom;
+
+            cv::Vec3d onCamRay = camDir * s;
+            cv::Vec3d onProjRay = projectorCenter + projDir * u;
+            cv::Vec3d midpoint = (onCamRay + onProjRay) * 0.5;
+            points[i] = cv::Point3f(midpoint[0], midpoint[1], midpoint[2]);
+            residuals[i] = (s > 0 && u > 0) ? cv::norm(onCamRay - onProjRay) : infinity;
+        }
+    }
+}
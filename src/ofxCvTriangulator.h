@@ -0,0 +1,55 @@
+/*
+ * ofxCvTriangulator.h
+ *
+ * Triangulates camera <-> projector correspondences (e.g. decoded from a
+ * structured light scan) into 3D points in the camera frame, with the midpoint
+ * method. Points are processed in chunks across a worker pool.
+ */
+
+#pragma once
+
+#include "ofMain.h"
+#include "ofxCv.h"
+#include "ofxCvCameraProjectorCalibration.h"
+#include "ofxCvWorkerPool.h"
+#include "ofxCvUndistortionMap.h"
+
+namespace ofxCv {
+
+    class Triangulator {
+
+    public:
+        Triangulator();
+
+        // copies the calibration. Points are undistorted through lookup tables with one node every
+        // undistortionGridStep pixels, or with the iterative cv::undistortPoints if it's 0
+        void setup(const CameraProjectorCalibration & calibration, int numThreads = 0, int undistortionGridStep = 8);
+        // number of correspondences per parallel task
+        void setChunkSize(int numPoints) { chunkSize = MAX(1, numPoints); }
+
+        // camPts & projPts in pixels, distorted. The outputs are only reallocated when the
+        // number of points grows. residuals is the distance between the two rays, in the
+        // calibration unit, and is infinite when the rays don't meet in front of both devices
+        void triangulate(const vector<cv::Point2f> & camPts, const vector<cv::Point2f> & projPts,
+                         vector<cv::Point3f> & points, vector<float> & residuals);
+
+    protected:
+        void triangulateChunk(int start, int count,
+                              const cv::Point2f * camPts, const cv::Point2f * projPts,
+                              cv::Point3f * points, float * residuals);
+
+        cv::Mat cameraMatrix, cameraDistCoeffs;
+        cv::Mat projectorMatrix, projectorDistCoeffs;
+        // projector frame expressed in the camera frame
+        cv::Matx33d rotProjToCam;
+        cv::Vec3d projectorCenter;
+
+        bool bUndistortionMaps;
+        UndistortionMap cameraUndistortion, projectorUndistortion;
+
+        WorkerPool workers;
+        int chunkSize;
+        // undistorted normalized coordinates, reused between calls
+        vector<cv::Point2f> camRays, projRays;
+    };
+}
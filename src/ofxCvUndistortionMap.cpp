@@ -0,0 +1,80 @@
+/*
+ * ofxCvUndistortionMap.cpp
+ *
+ * Lookup table from distorted pixels to undistorted normalized coordinates,
+ * sampled on a grid with the iterative solution and bilinearly interpolated,
+ * so dense point sets are undistorted at table lookup cost.
+ */
+
+#include "ofxCvUndistortionMap.h"
+
+namespace ofxCv {
+
+    UndistortionMap::UndistortionMap()
+    :gridCols(0)
+    ,gridRows(0)
+    ,gridStep(8)
+    ,maxError(0)
+    ,rmsError(0) {
+    }
+
+    void UndistortionMap::setup(const cv::Mat & cameraMatrix, const cv::Mat & distCoeffs, cv::Size imageSize, int gridStep){
+
+        this->cameraMatrix = cameraMatrix.clone();
+        this->distCoeffs = distCoeffs.clone();
+        this->imageSize = imageSize;
+        this->gridStep = MAX(1, gridStep);
+
+        // one extra node past the right & bottom borders
+        gridCols = MAX(2, (int) ceil(imageSize.width / this->gridStep) + 2);
+        gridRows = MAX(2, (int) ceil(imageSize.height / this->gridStep) + 2);
+
+        vector<cv::Point2f> nodes(gridCols * gridRows);
+        for(int y = 0; y < gridRows; y++) {
+            for(int x = 0; x < gridCols; x++) {
+                nodes[y * gridCols + x] = cv::Point2f(x, y) * this->gridStep;
+            }
+        }
+        cv::undistortPoints(nodes, grid, cameraMatrix, distCoeffs);
+
+        // accuracy where the interpolation is the worst, converted back to pixels
+        vector<cv::Point2f> centers, exact;
+        for(int y = 0; y < gridRows - 1; y++) {
+            for(int x = 0; x < gridCols - 1; x++) {
+                centers.push_back(cv::Point2f(x + .5f, y + .5f) * this->gridStep);
+            }
+        }
+        cv::undistortPoints(centers, exact, cameraMatrix, distCoeffs);
+        double fx = cameraMatrix.at<double>(0, 0), fy = cameraMatrix.at<double>(1, 1);
+        double squaredError = 0;
+        maxError = 0;
+        for(size_t i = 0; i < centers.size(); i++) {
+            cv::Point2f d = undistort(centers[i]) - exact[i];
+            float error = sqrt(d.x * d.x * fx * fx + d.y * d.y * fy * fy);
+            squaredError += error * error;
+            maxError = MAX(maxError, error);
+        }
+        rmsError = sqrt(squaredError / centers.size());
+
+        ofLogVerbose("UndistortionMap") << gridCols << "x" << gridRows << " grid, error max "
+                                        << maxError << "px, rms " << rmsError << "px";
+    }
+
+    bool UndistortionMap::matches(const cv::Mat & cameraMatrix, const cv::Mat & distCoeffs, cv::Size imageSize) const {
+        if(!isSetup() || this->imageSize != imageSize) return false;
+        if(cameraMatrix.size() != this->cameraMatrix.size() || distCoeffs.size() != this->distCoeffs.size()) return false;
+        return cv::norm(cameraMatrix, this->cameraMatrix, cv::NORM_INF) == 0 &&
+               cv::norm(distCoeffs, this->distCoeffs, cv::NORM_INF) == 0;
+    }
+
+    void UndistortionMap::undistort(const cv::Point2f * pts, cv::Point2f * out, int count) const {
+        for(int i = 0; i < count; i++) {
+            out[i] = undistort(pts[i]);
+        }
+    }
+
+    void UndistortionMap::undistort(const vector<cv::Point2f> & pts, vector<cv::Point2f> & out) const {
+        out.resize(pts.size());
+        if(!pts.empty()) undistort(&pts[0], &out[0], pts.size());
+    }
+}
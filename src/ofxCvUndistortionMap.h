@@ -0,0 +1,58 @@
+/*
+ * ofxCvUndistortionMap.h
+ *
+ * Lookup table from distorted pixels to undistorted normalized coordinates,
+ * sampled on a grid with the iterative solution and bilinearly interpolated,
+ * so dense point sets are undistorted at table lookup cost.
+ */
+
+#pragma once
+
+#include "ofMain.h"
+#include "ofxCv.h"
+
+namespace ofxCv {
+
+    class UndistortionMap {
+
+    public:
+        UndistortionMap();
+
+        // one node every gridStep pixels over the image
+        void setup(const cv::Mat & cameraMatrix, const cv::Mat & distCoeffs, cv::Size imageSize, int gridStep = 8);
+        bool isSetup() const { return !grid.empty(); }
+        // true if the map was built for these intrinsics
+        bool matches(const cv::Mat & cameraMatrix, const cv::Mat & distCoeffs, cv::Size imageSize) const;
+
+        // pixel -> undistorted (x, y) with z = 1, like cv::undistortPoints without P
+        cv::Point2f undistort(const cv::Point2f & pt) const;
+        void undistort(const cv::Point2f * pts, cv::Point2f * out, int count) const;
+        void undistort(const vector<cv::Point2f> & pts, vector<cv::Point2f> & out) const;
+
+        // interpolation error against cv::undistortPoints at the cell centers, in pixels
+        float getMaxError() const { return maxError; }
+        float getRmsError() const { return rmsError; }
+
+    protected:
+        cv::Mat cameraMatrix, distCoeffs;
+        cv::Size imageSize;
+
+        vector<cv::Point2f> grid;
+        int gridCols, gridRows;
+        float gridStep;
+        float maxError, rmsError;
+    };
+
+    inline cv::Point2f UndistortionMap::undistort(const cv::Point2f & pt) const {
+        // bilinear interpolation, extrapolated linearly outside of the image
+        float gx = pt.x / gridStep;
+        float gy = pt.y / gridStep;
+        int ix = ofClamp((int) floorf(gx), 0, gridCols - 2);
+        int iy = ofClamp((int) floorf(gy), 0, gridRows - 2);
+        float fx = gx - ix, fy = gy - iy;
+        const cv::Point2f * row = &grid[iy * gridCols + ix];
+        cv::Point2f top = row[0] * (1 - fx) + row[1] * fx;
+        cv::Point2f bottom = row[gridCols] * (1 - fx) + row[gridCols + 1] * fx;
+        return top * (1 - fy) + bottom * fy;
+    }
+}
@@ -0,0 +1,106 @@
+/*
+ * ofxCvWorkerPool.cpp
+ *
+ * Persistent pool of worker threads running index-based parallel loops.
+ * Each task writes to its own slot, so results keep the input order.
+ */
+
+#include "ofxCvWorkerPool.h"
+
+namespace ofxCv {
+
+    WorkerPool::WorkerPool(int numThreads)
+    :task(NULL)
+    ,taskCount(0)
+    ,nextTask(0)
+    ,finishedWorkers(0)
+    ,generation(0)
+    ,bStopping(false) {
+        setup(numThreads);
+    }
+
+    WorkerPool::~WorkerPool(){
+        stop();
+    }
+
+    void WorkerPool::setup(int numThreads){
+        stop();
+
+        if(numThreads <= 0) {
+            numThreads = MAX(1, (int) std::thread::hardware_concurrency());
+        }
+        bStopping = false;
+        for(int i = 0; i < numThreads - 1; i++) {
+            workers.push_back(std::thread(&WorkerPool::work, this, generation));
+        }
+    }
+
+    void WorkerPool::stop(){
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            bStopping = true;
+        }
+        wakeCondition.notify_all();
+        for(size_t i = 0; i < workers.size(); i++) {
+            workers[i].join();
+        }
+        workers.clear();
+    }
+
+    void WorkerPool::runTasks(){
+        int i;
+        while((i = nextTask++) < taskCount) {
+            (*task)(i);
+        }
+    }
+
+    void WorkerPool::work(unsigned long lastGeneration){
+        while(true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                while(!bStopping && generation == lastGeneration) {
+                    wakeCondition.wait(lock);
+                }
+                if(bStopping) return;
+                lastGeneration = generation;
+            }
+
+            runTasks();
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                finishedWorkers++;
+            }
+            doneCondition.notify_all();
+        }
+    }
+
+    void WorkerPool::parallelFor(int count, const std::function<void(int)> & task){
+        if(count <= 0) return;
+
+        if(workers.empty() || count == 1) {
+            for(int i = 0; i < count; i++) task(i);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            this->task = &task;
+            taskCount = count;
+            nextTask = 0;
+            finishedWorkers = 0;
+            generation++;
+        }
+        wakeCondition.notify_all();
+
+        runTasks();
+
+        // every index has been claimed, wait until each worker is done with this loop
+        std::unique_lock<std::mutex> lock(mutex);
+        while(finishedWorkers < (int) workers.size()) {
+            doneCondition.wait(lock);
+        }
+        this->task = NULL;
+        taskCount = 0;
+    }
+}
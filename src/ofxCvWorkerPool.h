@@ -0,0 +1,50 @@
+/*
+ * ofxCvWorkerPool.h
+ *
+ * Persistent pool of worker threads running index-based parallel loops.
+ * Each task writes to its own slot, so results keep the input order.
+ */
+
+#pragma once
+
+#include "ofMain.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+namespace ofxCv {
+
+    class WorkerPool {
+
+    public:
+        // 0 threads : one per hardware core
+        WorkerPool(int numThreads = 0);
+        ~WorkerPool();
+
+        void setup(int numThreads = 0);
+        int getNumThreads() const { return workers.size() + 1; }
+
+        // runs task(i) for every i in [0, count) and returns once all are done,
+        // the calling thread takes part in the work
+        void parallelFor(int count, const std::function<void(int)> & task);
+
+    protected:
+        void stop();
+        void work(unsigned long lastGeneration);
+        void runTasks();
+
+        vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable wakeCondition, doneCondition;
+
+        const std::function<void(int)> * task;
+        int taskCount;
+        std::atomic<int> nextTask;
+        int finishedWorkers;
+        unsigned long generation;
+        bool bStopping;
+    };
+}